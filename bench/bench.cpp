@@ -0,0 +1,909 @@
+#include <span>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize2.h>
+
+#include "../src/gl/gl.h"
+#include "../src/parallel.h"
+#include "../src/bitmap.h"
+#include "../src/cubemap.h"
+#include "../src/texture_cache.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Referenced by cubemap.cpp; the benchmark never issues GL calls
+GL4API api;
+
+using BenchInput = std::pair<std::string, Bitmap>;
+
+static void benchIrradianceScaling(const std::vector<BenchInput>& inputs);
+static void benchIrradianceKernel(const std::vector<BenchInput>& inputs);
+static void benchIrradianceSamplers(const std::vector<BenchInput>& inputs);
+static void benchCubemapConversion(const std::vector<BenchInput>& inputs);
+static void benchPixelAccess(const std::vector<BenchInput>& inputs);
+static void benchSpecularPrefilter(const std::vector<BenchInput>& inputs);
+static void benchResample(const std::vector<BenchInput>& inputs);
+static void benchBlockCompression(const std::vector<BenchInput>& inputs);
+static void benchCubemapCache(const std::vector<std::string>& fileNames);
+static void benchHdrDecode(const std::vector<std::string>& fileNames);
+static void benchTextureDecode();
+static void benchMaterialCompression();
+static void benchPipeline(const std::string& jsonFileName, const std::vector<std::string>& fileNames, int maxWidth);
+static Bitmap convertDiffuseToIrradianceReference(const Bitmap& input, int dstW, int dstH, int numMonteCarloSamples);
+static Bitmap integrateIrradianceExactly(const Bitmap& input, int dstW, int dstH);
+static float getRmsRelativeError(const Bitmap& reference, const Bitmap& bitmap);
+static Bitmap makeSyntheticEquirect(int width, int height);
+static std::vector<std::string> writeSyntheticTextures(const std::filesystem::path& directory, int count, int size);
+static std::vector<unsigned int> getThreadCounts();
+static size_t getPeakRssBytes();
+static std::string escapeJson(const std::string& text);
+static bool isBitIdentical(const Bitmap& a, const Bitmap& b);
+static float getMaxRelativeError(const Bitmap& reference, const Bitmap& bitmap);
+
+template<typename Function>
+static double measureMilliseconds(Function&& function)
+{
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Usage: meshview_bench [--json results.json [--max-width N]] [equirect.hdr ...]
+// Without files, synthetic 1K/4K/8K environment maps are generated (512 to 16K wide with --json).
+// --json only runs the pipeline stages and writes their timings to the given file, see benchPipeline().
+int main(int argc, char** argv)
+{
+    std::vector<std::string> fileNames;
+    std::string jsonFileName;
+    int maxWidth = 16384;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            jsonFileName = argv[++i];
+        }
+        else if (arg == "--max-width" && i + 1 < argc) {
+            maxWidth = std::atoi(argv[++i]);
+        }
+        else {
+            fileNames.push_back(arg);
+        }
+    }
+    if (!jsonFileName.empty()) {
+        benchPipeline(jsonFileName, fileNames, maxWidth);
+        setThreadCount(0);
+        return 0;
+    }
+
+    std::vector<BenchInput> inputs;
+    if (!fileNames.empty()) {
+        for (const std::string& fileName : fileNames) {
+            inputs.emplace_back(fileName, Bitmap(fileName));
+        }
+    }
+    else {
+        for (int width : { 1024, 4096, 8192 }) {
+            inputs.emplace_back("synthetic " + std::to_string(width / 1024) + "K", makeSyntheticEquirect(width, width / 2));
+        }
+    }
+
+    benchIrradianceScaling(inputs);
+    benchIrradianceKernel(inputs);
+    benchIrradianceSamplers(inputs);
+    benchCubemapConversion(inputs);
+    benchPixelAccess(inputs);
+    benchSpecularPrefilter(inputs);
+    benchResample(inputs);
+    benchBlockCompression(inputs);
+    benchCubemapCache(fileNames);
+    benchHdrDecode(fileNames);
+    benchTextureDecode();
+    benchMaterialCompression();
+    setThreadCount(0);
+    return 0;
+}
+
+static void benchIrradianceScaling(const std::vector<BenchInput>& inputs)
+{
+    const std::vector<unsigned int> threadCounts = getThreadCounts();
+    for (const auto& [name, input] : inputs) {
+        std::printf("convertDiffuseToIrradiance: %s (%dx%d)\n", name.c_str(), input.getWidth(), input.getHeight());
+        Bitmap reference;
+        double referenceMs = 0.0;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap irradiance;
+            const double ms = measureMilliseconds([&]() {
+                irradiance = Bitmap::convertDiffuseToIrradiance(input, input.getWidth(), input.getHeight(), 256, 128, 1024);
+            });
+            if (numThreads == 1) {
+                reference = std::move(irradiance);
+                referenceMs = ms;
+                std::printf("  threads %2u  %9.1f ms\n", numThreads, ms);
+            }
+            else {
+                std::printf("  threads %2u  %9.1f ms  speedup %5.2fx  %s\n", numThreads, ms, referenceMs / ms,
+                    isBitIdentical(reference, irradiance) ? "bit-identical" : "MISMATCH");
+            }
+        }
+    }
+}
+
+static void benchIrradianceKernel(const std::vector<BenchInput>& inputs)
+{
+    // Single-threaded, so the numbers isolate the integrator itself
+    setThreadCount(1);
+    for (const auto& [name, input] : inputs) {
+        std::printf("irradiance integrator: %s (%dx%d)\n", name.c_str(), input.getWidth(), input.getHeight());
+        for (int numSamples : { 256, 1024, 4096 }) {
+            Bitmap reference;
+            Bitmap irradiance;
+            const double referenceMs = measureMilliseconds([&]() {
+                reference = convertDiffuseToIrradianceReference(input, 256, 128, numSamples);
+            });
+            const double ms = measureMilliseconds([&]() {
+                irradiance = Bitmap::convertDiffuseToIrradiance(input, input.getWidth(), input.getHeight(), 256, 128, numSamples);
+            });
+            std::printf("  samples %5d  scalar %9.1f ms  vectorized %9.1f ms  speedup %5.2fx  max rel. error %.2e\n",
+                numSamples, referenceMs, ms, referenceMs / ms, getMaxRelativeError(reference, irradiance));
+        }
+    }
+}
+
+static void benchIrradianceSamplers(const std::vector<BenchInput>& inputs)
+{
+    setThreadCount(0);
+    for (const auto& [name, input] : inputs) {
+        std::printf("irradiance samplers, RMS error against exact integration: %s (%dx%d)\n", name.c_str(), input.getWidth(), input.getHeight());
+        const Bitmap reference = integrateIrradianceExactly(input, 256, 128);
+        for (auto [samplerName, sampler] : { std::pair("uniform", IrradianceSampler::Uniform), std::pair("cosine", IrradianceSampler::CosineWeighted) }) {
+            for (int numSamples : { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096 }) {
+                Bitmap irradiance;
+                const double ms = measureMilliseconds([&]() {
+                    irradiance = Bitmap::convertDiffuseToIrradiance(input, input.getWidth(), input.getHeight(), 256, 128, numSamples, sampler);
+                });
+                std::printf("  %-7s  samples %5d  %9.1f ms  RMS rel. error %.3e\n", samplerName, numSamples, ms, getRmsRelativeError(reference, irradiance));
+            }
+        }
+    }
+}
+
+static void benchCubemapConversion(const std::vector<BenchInput>& inputs)
+{
+    setThreadCount(0);
+    for (const auto& [name, input] : inputs) {
+        std::printf("equirect to cubemap faces: %s (%dx%d)\n", name.c_str(), input.getWidth(), input.getHeight());
+        Bitmap reference;
+        size_t twoPassPeakBytes = 0;
+        const double twoPassMs = measureMilliseconds([&]() {
+            Bitmap cross = Bitmap::convertEquirectangularMapToVerticalCross(input);
+            reference = Bitmap::convertVerticalCrossToCubeMapFaces(cross);
+            twoPassPeakBytes = cross.getByteSize() + reference.getByteSize();
+        });
+        // The first fused conversion of a resolution builds its sampling table, the second one reuses it
+        Bitmap faces;
+        const double fusedColdMs = measureMilliseconds([&]() {
+            faces = Bitmap::convertEquirectangularMapToCubeMapFaces(input);
+        });
+        Bitmap facesWarm;
+        const double fusedWarmMs = measureMilliseconds([&]() {
+            facesWarm = Bitmap::convertEquirectangularMapToCubeMapFaces(input);
+        });
+        // Peak memory on top of the equirect input
+        std::printf("  two-pass      %9.1f ms  %8.1f MB\n", twoPassMs, twoPassPeakBytes / 1048576.0);
+        std::printf("  fused (cold)  %9.1f ms  %8.1f MB  speedup %5.2fx  %s\n", fusedColdMs, faces.getByteSize() / 1048576.0,
+            twoPassMs / fusedColdMs, isBitIdentical(reference, faces) ? "bit-identical" : "MISMATCH");
+        std::printf("  fused (warm)  %9.1f ms  %8.1f MB  speedup %5.2fx  %s\n", fusedWarmMs, facesWarm.getByteSize() / 1048576.0,
+            twoPassMs / fusedWarmMs, isBitIdentical(reference, facesWarm) ? "bit-identical" : "MISMATCH");
+        for (auto [formatName, format] : { std::pair("RGB16F", BitmapFormat::RGB16F), std::pair("R11G11B10F", BitmapFormat::R11G11B10F) }) {
+            Bitmap compactFaces;
+            const double compactMs = measureMilliseconds([&]() {
+                compactFaces = Bitmap::convertEquirectangularMapToCubeMapFaces(input, format);
+            });
+            std::printf("  %-12s  %9.1f ms  %8.1f MB  max rel. error %.2e\n", formatName, compactMs, compactFaces.getByteSize() / 1048576.0,
+                getMaxRelativeError(reference, compactFaces));
+        }
+    }
+}
+
+static void benchPixelAccess(const std::vector<BenchInput>& inputs)
+{
+    // Single-threaded, so the numbers compare the access paths themselves
+    setThreadCount(1);
+    for (const auto& [name, input] : inputs) {
+        std::printf("pixel access: %s (%dx%d)\n", name.c_str(), input.getWidth(), input.getHeight());
+        const Bitmap source = Bitmap::convertFormat(input, BitmapFormat::RGB32F);
+
+        Bitmap scaledPerPixel(source.getWidth(), source.getHeight(), 1);
+        const double scalePerPixelMs = measureMilliseconds([&]() {
+            for (int y = 0; y < source.getHeight(); y++) {
+                for (int x = 0; x < source.getWidth(); x++) {
+                    scaledPerPixel.setPixel(x, y, 0, source.getPixel(x, y, 0) * 0.5f);
+                }
+            }
+        });
+        Bitmap scaledRows(source.getWidth(), source.getHeight(), 1);
+        const double scaleRowsMs = measureMilliseconds([&]() {
+            for (int y = 0; y < source.getHeight(); y++) {
+                const std::span<const glm::vec3> src = source.getPixels<glm::vec3>(y);
+                const std::span<glm::vec3> dst = scaledRows.getPixels<glm::vec3>(y);
+                for (size_t x = 0; x < src.size(); x++) {
+                    dst[x] = src[x] * 0.5f;
+                }
+            }
+        });
+        std::printf("  scale RGB32F  per-pixel %9.1f ms  rows %9.1f ms  speedup %5.2fx  %s\n", scalePerPixelMs, scaleRowsMs,
+            scalePerPixelMs / scaleRowsMs, isBitIdentical(scaledPerPixel, scaledRows) ? "bit-identical" : "MISMATCH");
+
+        Bitmap halfPerPixel(source.getWidth(), source.getHeight(), 1, BitmapFormat::RGB16F);
+        const double convertPerPixelMs = measureMilliseconds([&]() {
+            for (int y = 0; y < source.getHeight(); y++) {
+                for (int x = 0; x < source.getWidth(); x++) {
+                    halfPerPixel.setPixel(x, y, 0, source.getPixel(x, y, 0));
+                }
+            }
+        });
+        Bitmap halfRows;
+        const double convertRowsMs = measureMilliseconds([&]() {
+            halfRows = Bitmap::convertFormat(source, BitmapFormat::RGB16F);
+        });
+        std::printf("  to RGB16F     per-pixel %9.1f ms  rows %9.1f ms  speedup %5.2fx  %s\n", convertPerPixelMs, convertRowsMs,
+            convertPerPixelMs / convertRowsMs, isBitIdentical(halfPerPixel, halfRows) ? "bit-identical" : "MISMATCH");
+    }
+}
+
+static void benchSpecularPrefilter(const std::vector<BenchInput>& inputs)
+{
+    const std::vector<unsigned int> threadCounts = getThreadCounts();
+    for (const auto& [name, input] : inputs) {
+        setThreadCount(0);
+        const Bitmap faces = Bitmap::convertEquirectangularMapToCubeMapFaces(input);
+        // Down to 8x8 faces with 128 samples, like Cubemap
+        int numLevels = 1;
+        while ((faces.getWidth() >> numLevels) >= 8) {
+            numLevels++;
+        }
+        std::printf("GGX prefilter: %s (%d faces of %dx%d, %d levels)\n", name.c_str(), faces.getDepth(), faces.getWidth(), faces.getHeight(), numLevels);
+        std::vector<Bitmap> reference;
+        double referenceMs = 0.0;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            std::vector<Bitmap> levels;
+            const double ms = measureMilliseconds([&]() {
+                levels = Bitmap::convertCubeMapFacesToPrefilteredMips(faces, numLevels, 128, BitmapFormat::RGB16F);
+            });
+            if (numThreads == 1) {
+                reference = std::move(levels);
+                referenceMs = ms;
+                std::printf("  threads %2u  %9.1f ms\n", numThreads, ms);
+            }
+            else {
+                bool identical = true;
+                for (size_t level = 0; level < levels.size(); level++) {
+                    identical = identical && isBitIdentical(reference[level], levels[level]);
+                }
+                std::printf("  threads %2u  %9.1f ms  speedup %5.2fx  %s\n", numThreads, ms, referenceMs / ms, identical ? "bit-identical" : "MISMATCH");
+            }
+        }
+    }
+}
+
+static void benchResample(const std::vector<BenchInput>& inputs)
+{
+    for (const auto& [name, input] : inputs) {
+        setThreadCount(0);
+        const Bitmap source = Bitmap::convertFormat(input, BitmapFormat::RGB32F);
+        const int dstW = source.getWidth() / 4;
+        const int dstH = source.getHeight() / 4;
+        std::printf("Resampling: %s (%dx%d to %dx%d)\n", name.c_str(), source.getWidth(), source.getHeight(), dstW, dstH);
+        std::vector<float> stbResult(static_cast<size_t>(dstW) * dstH * 3);
+        const double stbMs = measureMilliseconds([&]() {
+            stbir_resize(
+                reinterpret_cast<const float*>(source.getData()), source.getWidth(), source.getHeight(), 0,
+                stbResult.data(), dstW, dstH, 0,
+                static_cast<stbir_pixel_layout>(3), STBIR_TYPE_FLOAT, STBIR_EDGE_CLAMP, STBIR_FILTER_CUBICBSPLINE);
+        });
+        std::printf("  stb_image_resize (cubic B-spline)  %9.1f ms\n", stbMs);
+        for (ResampleFilter filter : { ResampleFilter::Box, ResampleFilter::Kaiser }) {
+            const char* filterName = filter == ResampleFilter::Box ? "box" : "Kaiser";
+            const double ms = measureMilliseconds([&]() {
+                Bitmap::resample(source, dstW, dstH, filter, ResampleEdge::Wrap, ResampleEdge::Clamp);
+            });
+            std::printf("  Bitmap::resample (%-6s)          %9.1f ms  speedup %5.2fx\n", filterName, ms, stbMs / ms);
+        }
+
+        const Bitmap faces = Bitmap::convertEquirectangularMapToCubeMapFaces(input);
+        for (ResampleFilter filter : { ResampleFilter::Box, ResampleFilter::Kaiser }) {
+            const char* filterName = filter == ResampleFilter::Box ? "box" : "Kaiser";
+            std::vector<Bitmap> levels;
+            const double ms = measureMilliseconds([&]() {
+                levels = Bitmap::generateCubeMapMips(faces, filter);
+            });
+            std::printf("  cube mips %dx%d (%-6s, %zu levels)   %9.1f ms\n", faces.getWidth(), faces.getHeight(), filterName, levels.size(), ms);
+        }
+    }
+}
+
+static void benchBlockCompression(const std::vector<BenchInput>& inputs)
+{
+    const std::vector<unsigned int> threadCounts = getThreadCounts();
+    for (const auto& [name, input] : inputs) {
+        setThreadCount(0);
+        const Bitmap faces = Bitmap::convertEquirectangularMapToCubeMapFaces(input, BitmapFormat::RGB16F);
+        std::printf("BC6H encoding: %s (%d faces of %dx%d, %.1f MB as RGB16F)\n",
+            name.c_str(), faces.getDepth(), faces.getWidth(), faces.getHeight(), faces.getByteSize() / 1048576.0);
+        Bitmap reference;
+        double referenceMs = 0.0;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap encoded;
+            const double ms = measureMilliseconds([&]() {
+                encoded = Bitmap::convertFormat(faces, BitmapFormat::BC6H);
+            });
+            if (numThreads == 1) {
+                reference = std::move(encoded);
+                referenceMs = ms;
+                std::printf("  threads %2u  %9.1f ms  %.1f MB\n", numThreads, ms, reference.getByteSize() / 1048576.0);
+            }
+            else {
+                std::printf("  threads %2u  %9.1f ms  speedup %5.2fx  %s\n", numThreads, ms, referenceMs / ms, isBitIdentical(reference, encoded) ? "bit-identical" : "MISMATCH");
+            }
+        }
+        setThreadCount(0);
+        const Bitmap decoded = Bitmap::convertFormat(reference, BitmapFormat::RGB16F);
+        std::printf("  RMS relative error %.4f, max %.4f\n", getRmsRelativeError(faces, decoded), getMaxRelativeError(faces, decoded));
+    }
+}
+
+static void benchCubemapCache(const std::vector<std::string>& fileNames)
+{
+    // Cubemap::loadData keeps its cache in the working directory, so this replaces any existing cache of the same name
+    setThreadCount(0);
+    for (const std::string& fileName : fileNames) {
+        std::printf("IBL cache: %s\n", fileName.c_str());
+        std::filesystem::remove(std::filesystem::path(fileName).stem().string() + ".iblcache");
+        for (IrradianceMode mode : { IrradianceMode::MonteCarlo, IrradianceMode::SphericalHarmonics }) {
+            const double coldMs = measureMilliseconds([&]() {
+                Cubemap::loadData(fileName, mode, BitmapFormat::RGB16F);
+            });
+            const double warmMs = measureMilliseconds([&]() {
+                Cubemap::loadData(fileName, mode, BitmapFormat::RGB16F);
+            });
+            std::printf("  %-19s  cold %9.1f ms  warm %9.1f ms  speedup %7.1fx\n",
+                mode == IrradianceMode::MonteCarlo ? "Monte Carlo" : "spherical harmonics", coldMs, warmMs, coldMs / warmMs);
+        }
+    }
+}
+
+static void benchHdrDecode(const std::vector<std::string>& fileNames)
+{
+    for (const std::string& fileName : fileNames) {
+        std::printf("Radiance decoding: %s\n", fileName.c_str());
+        // stb_image, as Bitmap used it before: decode to floats, then copy into the bitmap
+        int width = 0;
+        int height = 0;
+        float* stbData = nullptr;
+        const double stbMs = measureMilliseconds([&]() {
+            stbData = stbi_loadf(fileName.c_str(), &width, &height, nullptr, 3);
+        });
+        if (!stbData) {
+            std::printf("  not readable by stb_image\n");
+            continue;
+        }
+        const size_t floatBytes = static_cast<size_t>(width) * height * 3 * sizeof(float);
+        std::printf("  stb_image               %9.1f ms  %8.1f MB peak\n", stbMs, 2.0 * floatBytes / 1048576.0);
+        for (unsigned int numThreads : getThreadCounts()) {
+            setThreadCount(numThreads);
+            Bitmap bitmap;
+            const double ms = measureMilliseconds([&]() {
+                bitmap = Bitmap(fileName);
+            });
+            const bool identical = bitmap.getByteSize() == floatBytes && std::memcmp(bitmap.getData(), stbData, floatBytes) == 0;
+            std::printf("  native, threads %2u      %9.1f ms  %8.1f MB peak  speedup %5.2fx  %s\n", numThreads, ms,
+                bitmap.getByteSize() / 1048576.0, stbMs / ms, identical ? "bit-identical" : "MISMATCH");
+        }
+        stbi_image_free(stbData);
+
+        // The streamed SH projection only ever holds one band of the map
+        setThreadCount(0);
+        std::array<glm::vec3, 9> fromBitmap;
+        std::array<glm::vec3, 9> streamed;
+        const double inMemoryMs = measureMilliseconds([&]() {
+            fromBitmap = Bitmap::convertDiffuseToIrradianceSH(Bitmap(fileName));
+        });
+        const double streamedMs = measureMilliseconds([&]() {
+            streamed = Bitmap::convertDiffuseToIrradianceSH(std::string_view(fileName));
+        });
+        std::printf("  SH from bitmap          %9.1f ms  %8.1f MB peak\n", inMemoryMs, floatBytes / 1048576.0);
+        std::printf("  SH streamed             %9.1f ms  %8.1f MB peak  %s\n", streamedMs, width * 64 * 3 * sizeof(float) / 1048576.0,
+            std::memcmp(fromBitmap.data(), streamed.data(), sizeof(fromBitmap)) == 0 ? "bit-identical" : "MISMATCH");
+    }
+}
+
+// Material textures as Mesh loads them: decoded and mip-mapped one after another, each with parallel loops
+// of its own, versus concurrently with Bitmap::loadMips(). The 5-texture scene is DamagedHelmet (synthetic
+// 2K images if it is missing), the 500-texture one consists of small synthetic images.
+static void benchTextureDecode()
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "meshview_bench_textures";
+    std::vector<std::string> helmetFileNames;
+    for (const char* name : { "Default_albedo.jpg", "Default_metallicRoughness.jpg", "Default_AO.jpg", "Default_emissive.jpg", "Default_normal.jpg" }) {
+        helmetFileNames.push_back(std::string("data/DamagedHelmet/") + name);
+    }
+    if (!std::all_of(helmetFileNames.begin(), helmetFileNames.end(), [](const std::string& fileName) { return std::filesystem::exists(fileName); })) {
+        helmetFileNames = writeSyntheticTextures(directory / "5", 5, 2048);
+    }
+    const std::vector<std::pair<std::string, std::vector<std::string>>> scenes = {
+        { "5 textures", helmetFileNames },
+        { "500 textures", writeSyntheticTextures(directory / "500", 500, 256) }
+    };
+
+    for (const auto& [name, fileNames] : scenes) {
+        std::printf("Material texture decoding: %s\n", name.c_str());
+        std::vector<std::pair<std::string, MipContent>> images;
+        for (const std::string& fileName : fileNames) {
+            images.push_back({ fileName, MipContent::Linear });
+        }
+        for (unsigned int numThreads : getThreadCounts()) {
+            setThreadCount(numThreads);
+            std::vector<std::vector<Bitmap>> sequential;
+            const double sequentialMs = measureMilliseconds([&]() {
+                for (const std::string& fileName : fileNames) {
+                    sequential.push_back(Bitmap::generateMips(Bitmap(fileName, BitmapFormat::RGBA8), ResampleFilter::Kaiser, BitmapFormat::RGBA8));
+                }
+            });
+            std::vector<std::vector<Bitmap>> concurrent;
+            const double concurrentMs = measureMilliseconds([&]() {
+                concurrent = Bitmap::loadMips(images, ResampleFilter::Kaiser, BitmapFormat::RGBA8);
+            });
+            bool identical = sequential.size() == concurrent.size();
+            for (size_t i = 0; identical && i < sequential.size(); i++) {
+                identical = sequential[i].size() == concurrent[i].size();
+                for (size_t level = 0; identical && level < sequential[i].size(); level++) {
+                    identical = isBitIdentical(sequential[i][level], concurrent[i][level]);
+                }
+            }
+            std::printf("  threads %2u  sequential %9.1f ms  concurrent %9.1f ms  speedup %5.2fx  %s\n",
+                numThreads, sequentialMs, concurrentMs, sequentialMs / concurrentMs, identical ? "bit-identical" : "MISMATCH");
+        }
+    }
+    std::error_code error;
+    std::filesystem::remove_all(directory, error);
+}
+
+// Block compression of the DamagedHelmet textures: speed, scaling and error per format, then the texture cache
+static void benchMaterialCompression()
+{
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "meshview_bench_compression";
+    std::vector<std::pair<std::string, TextureEncoding>> images = {
+        { "data/DamagedHelmet/Default_albedo.jpg", TextureEncoding::ColorSRGB },
+        { "data/DamagedHelmet/Default_metallicRoughness.jpg", TextureEncoding::MetallicRoughness },
+        { "data/DamagedHelmet/Default_AO.jpg", TextureEncoding::Occlusion },
+        { "data/DamagedHelmet/Default_emissive.jpg", TextureEncoding::ColorSRGB },
+        { "data/DamagedHelmet/Default_normal.jpg", TextureEncoding::Normals }
+    };
+    if (!std::all_of(images.begin(), images.end(), [](const auto& image) { return std::filesystem::exists(image.first); })) {
+        const std::vector<std::string> fileNames = writeSyntheticTextures(directory, static_cast<int>(images.size()), 2048);
+        for (size_t i = 0; i < images.size(); i++) {
+            images[i].first = fileNames[i];
+        }
+    }
+
+    // Level 0 in the format of each encoding; the error is measured on the channels the format keeps
+    const std::vector<unsigned int> threadCounts = getThreadCounts();
+    for (const auto& [fileName, encoding] : images) {
+        setThreadCount(0);
+        const BitmapFormat format = getTextureEncodingFormat(encoding);
+        const Bitmap input(fileName, BitmapFormat::RGBA8);
+        const char* formatName = format == BitmapFormat::BC7 ? "BC7" : format == BitmapFormat::BC5 ? "BC5" : "BC4";
+        std::printf("%s encoding: %s (%dx%d)\n", formatName, std::filesystem::path(fileName).filename().string().c_str(), input.getWidth(), input.getHeight());
+        Bitmap reference;
+        double referenceMs = 0.0;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap encoded;
+            const double ms = measureMilliseconds([&]() {
+                encoded = Bitmap::convertFormat(input, format);
+            });
+            if (numThreads == 1) {
+                reference = std::move(encoded);
+                referenceMs = ms;
+                std::printf("  threads %2u  %9.1f ms  %.2f MB, %.1fx smaller than RGBA8\n", numThreads, ms,
+                    reference.getByteSize() / 1048576.0, double(input.getByteSize()) / reference.getByteSize());
+            }
+            else {
+                std::printf("  threads %2u  %9.1f ms  speedup %5.2fx  %s\n", numThreads, ms, referenceMs / ms, isBitIdentical(reference, encoded) ? "bit-identical" : "MISMATCH");
+            }
+        }
+        setThreadCount(0);
+        const Bitmap decoded = Bitmap::convertFormat(reference, BitmapFormat::RGBA8);
+        const int numChannels = format == BitmapFormat::BC7 ? 4 : format == BitmapFormat::BC5 ? 2 : 1;
+        double squaredError = 0.0;
+        for (int y = 0; y < input.getHeight(); y++) {
+            const std::span<const uint8_t> inputRow = input.getRow(y);
+            const std::span<const uint8_t> decodedRow = decoded.getRow(y);
+            for (int x = 0; x < input.getWidth(); x++) {
+                for (int c = 0; c < numChannels; c++) {
+                    const double difference = double(inputRow[x * 4 + c]) - decodedRow[x * 4 + c];
+                    squaredError += difference * difference;
+                }
+            }
+        }
+        const double meanSquaredError = squaredError / (double(input.getWidth()) * input.getHeight() * numChannels);
+        std::printf("  PSNR %.2f dB\n", 10.0 * std::log10(255.0 * 255.0 / std::max(meanSquaredError, 1e-10)));
+    }
+
+    // A cache of its own, so the viewer's texturecache/ is left alone
+    const std::string cacheDirectory = (directory / "texturecache").string();
+    std::error_code error;
+    std::filesystem::remove_all(cacheDirectory, error);
+    std::vector<TextureData> textures;
+    const double coldMs = measureMilliseconds([&]() {
+        textures = loadTextureData(images, cacheDirectory);
+    });
+    const double warmMs = measureMilliseconds([&]() {
+        textures = loadTextureData(images, cacheDirectory);
+    });
+    size_t compressedSize = 0;
+    size_t uncompressedSize = 0;
+    for (const TextureData& texture : textures) {
+        for (int level = 0; level < static_cast<int>(texture.levels.size()); level++) {
+            compressedSize += texture.getLevelByteSize(level);
+            uncompressedSize += Bitmap::getLayerByteSize(BitmapFormat::RGBA8, texture.levels[level].width, texture.levels[level].height);
+        }
+    }
+    std::printf("Material texture cache: %zu textures, %.1f MB instead of %.1f MB as RGBA8\n", textures.size(), compressedSize / 1048576.0, uncompressedSize / 1048576.0);
+    std::printf("  cold %9.1f ms  warm %9.1f ms  speedup %7.1fx\n", coldMs, warmMs, coldMs / warmMs);
+    std::filesystem::remove_all(directory, error);
+}
+
+// Times the stages of the CPU IBL pipeline separately for every thread count and writes one JSON record
+// per input, stage and thread count, so results of different commits can be compared directly.
+// Throughput is in input megapixels per second of the stage. peakRssBytes is the peak resident set
+// size of the process so far; inputs run from small to large, so it grows with the largest stage run.
+static void benchPipeline(const std::string& jsonFileName, const std::vector<std::string>& fileNames, int maxWidth)
+{
+    struct PipelineInput {
+        std::string name;
+        std::string fileName;
+        // 0 for files passed on the command line
+        int syntheticWidth;
+    };
+    std::vector<PipelineInput> pipelineInputs;
+    for (const std::string& fileName : fileNames) {
+        pipelineInputs.push_back({ fileName, fileName, 0 });
+    }
+    if (fileNames.empty()) {
+        // Bitmap(std::string_view) reads files, so the synthetic maps are written as Radiance files first
+        for (int width = 512; width <= maxWidth; width *= 2) {
+            const std::filesystem::path path = std::filesystem::temp_directory_path() / ("meshview_bench_" + std::to_string(width) + ".hdr");
+            pipelineInputs.push_back({ "synthetic " + std::to_string(width) + "x" + std::to_string(width / 2), path.string(), width });
+        }
+    }
+
+    FILE* json = std::fopen(jsonFileName.c_str(), "w");
+    if (!json) {
+        std::printf("Could not open %s\n", jsonFileName.c_str());
+        return;
+    }
+    std::fprintf(json, "{\n  \"hardwareThreads\": %u,\n  \"results\": [", std::max(1u, std::thread::hardware_concurrency()));
+    bool isFirstRecord = true;
+    auto writeRecord = [&](const PipelineInput& input, int width, int height, const char* stage, unsigned int numThreads, double ms, double megapixels) {
+        std::fprintf(json, "%s\n    { \"input\": \"%s\", \"width\": %d, \"height\": %d, \"stage\": \"%s\", \"threads\": %u, "
+            "\"ms\": %.3f, \"mpixPerSecond\": %.3f, \"peakRssBytes\": %zu }",
+            isFirstRecord ? "" : ",", escapeJson(input.name).c_str(), width, height, stage, numThreads, ms, megapixels / (ms / 1000.0), getPeakRssBytes());
+        std::fflush(json);
+        isFirstRecord = false;
+        std::printf("  %-36s threads %2u  %9.1f ms  %8.1f Mpix/s\n", stage, numThreads, ms, megapixels / (ms / 1000.0));
+    };
+
+    // Small enough that every map from 2K up is streamed in several bands
+    constexpr size_t streamedMemoryBudget = 16 << 20;
+    const std::vector<unsigned int> threadCounts = getThreadCounts();
+    for (const PipelineInput& input : pipelineInputs) {
+        if (input.syntheticWidth > 0) {
+            setThreadCount(0);
+            const Bitmap synthetic = makeSyntheticEquirect(input.syntheticWidth, input.syntheticWidth / 2);
+            stbi_write_hdr(input.fileName.c_str(), synthetic.getWidth(), synthetic.getHeight(), 3, reinterpret_cast<const float*>(synthetic.getData()));
+        }
+        std::printf("pipeline: %s\n", input.name.c_str());
+        // Streamed straight from the file first, so the peak RSS of this stage is not hidden by the full decode below
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap faces;
+            const double ms = measureMilliseconds([&]() {
+                faces = Bitmap::loadEquirectangularMapAsCubeMapFaces(input.fileName, streamedMemoryBudget);
+            });
+            const int width = faces.getWidth() * 4;
+            writeRecord(input, width, width / 2, "loadEquirectangularMapAsCubeMapFaces", numThreads, ms, width * (width / 2.0) / 1e6);
+        }
+        // Each stage gets the output of the previous one from the first (single-threaded) run
+        Bitmap equirect;
+        Bitmap cross;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap bitmap;
+            const double ms = measureMilliseconds([&]() {
+                bitmap = Bitmap(input.fileName);
+            });
+            writeRecord(input, bitmap.getWidth(), bitmap.getHeight(), "Bitmap", numThreads, ms, bitmap.getWidth() * bitmap.getHeight() / 1e6);
+            if (equirect.getWidth() == 0) {
+                equirect = std::move(bitmap);
+            }
+        }
+        if (input.syntheticWidth > 0) {
+            std::filesystem::remove(input.fileName);
+        }
+        const int width = equirect.getWidth();
+        const int height = equirect.getHeight();
+        const double equirectMegapixels = width * static_cast<double>(height) / 1e6;
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap bitmap;
+            const double ms = measureMilliseconds([&]() {
+                bitmap = Bitmap::convertEquirectangularMapToVerticalCross(equirect);
+            });
+            writeRecord(input, width, height, "convertEquirectangularMapToVerticalCross", numThreads, ms, equirectMegapixels);
+            if (cross.getWidth() == 0) {
+                cross = std::move(bitmap);
+            }
+        }
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap faces;
+            const double ms = measureMilliseconds([&]() {
+                faces = Bitmap::convertVerticalCrossToCubeMapFaces(cross);
+            });
+            writeRecord(input, width, height, "convertVerticalCrossToCubeMapFaces", numThreads, ms, cross.getWidth() * static_cast<double>(cross.getHeight()) / 1e6);
+        }
+        cross = Bitmap();
+        // With the parameters Cubemap uses
+        for (unsigned int numThreads : threadCounts) {
+            setThreadCount(numThreads);
+            Bitmap irradiance;
+            const double ms = measureMilliseconds([&]() {
+                irradiance = Bitmap::convertDiffuseToIrradiance(equirect, width, height, 256, 128, 256, IrradianceSampler::CosineWeighted);
+            });
+            writeRecord(input, width, height, "convertDiffuseToIrradiance", numThreads, ms, equirectMegapixels);
+        }
+    }
+    std::fprintf(json, "\n  ]\n}\n");
+    std::fclose(json);
+    std::printf("results written to %s\n", jsonFileName.c_str());
+}
+
+// The scalar integrator as it was before the sample table and SIMD kernel were introduced
+static Bitmap convertDiffuseToIrradianceReference(const Bitmap& input, int dstW, int dstH, int numMonteCarloSamples)
+{
+    auto hammersley2d = [](uint32_t i, uint32_t N) {
+        uint32_t bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return glm::vec2(float(i) / float(N), float(bits) * 2.3283064365386963e-10f);
+    };
+
+    Bitmap result(dstW, dstH, 1);
+    const Bitmap resized = Bitmap::resample(input, dstW, dstH, ResampleFilter::Box, ResampleEdge::Wrap, ResampleEdge::Clamp);
+    const std::span<const glm::vec3> scratch(reinterpret_cast<const glm::vec3*>(resized.getData()), static_cast<size_t>(dstW) * dstH);
+    for (int y = 0; y < dstH; y++) {
+        const float theta1 = float(y) / float(dstH) * glm::pi<float>();
+        for (int x = 0; x < dstW; x++) {
+            const float phi1 = float(x) / float(dstW) * glm::two_pi<float>();
+            const glm::vec3 v1 = glm::vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
+            glm::vec3 color = glm::vec3(0.0f);
+            float weight = 0.0f;
+            for (int i = 0; i < numMonteCarloSamples; i++) {
+                const glm::vec2 h = hammersley2d(i, numMonteCarloSamples);
+                const int x1 = int(floor(h.x * dstW));
+                const int y1 = int(floor(h.y * dstH));
+                const float theta2 = float(y1) / float(dstH) * glm::pi<float>();
+                const float phi2 = float(x1) / float(dstW) * glm::two_pi<float>();
+                const glm::vec3 v2 = glm::vec3(sin(theta2) * cos(phi2), sin(theta2) * sin(phi2), cos(theta2));
+                const float nDotL = std::fmax(0.0f, glm::dot(v1, v2));
+                if (nDotL > 0.01f) {
+                    color += scratch[y1 * dstW + x1] * nDotL;
+                    weight += nDotL;
+                }
+            }
+            result.setPixel(x, y, 0, color / weight);
+        }
+    }
+    return result;
+}
+
+// Integrates every texel of the resized map that convertDiffuseToIrradiance samples, weighted by its solid
+// angle, which is what both samplers converge to. Texel directions follow the samplers' convention.
+static Bitmap integrateIrradianceExactly(const Bitmap& input, int dstW, int dstH)
+{
+    const Bitmap source = Bitmap::convertFormat(input, BitmapFormat::RGB32F);
+    const Bitmap resized = Bitmap::resample(source, dstW, dstH, ResampleFilter::Box, ResampleEdge::Wrap, ResampleEdge::Clamp);
+    const std::span<const glm::vec3> scratch(reinterpret_cast<const glm::vec3*>(resized.getData()), static_cast<size_t>(dstW) * dstH);
+    std::vector<glm::vec3> directions(dstW * dstH);
+    std::vector<float> solidAngles(dstW * dstH);
+    for (int y = 0; y < dstH; y++) {
+        const float theta = float(y) / float(dstH) * glm::pi<float>();
+        for (int x = 0; x < dstW; x++) {
+            const float phi = float(x) / float(dstW) * glm::two_pi<float>();
+            directions[y * dstW + x] = glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            solidAngles[y * dstW + x] = sin(theta);
+        }
+    }
+    Bitmap result(dstW, dstH, 1);
+    parallelFor(0, dstH, [&](int y) {
+        const float theta = float(y) / float(dstH) * glm::pi<float>();
+        const std::span<glm::vec3> row = result.getPixels<glm::vec3>(y);
+        for (int x = 0; x < dstW; x++) {
+            const float phi = float(x) / float(dstW) * glm::two_pi<float>();
+            const glm::dvec3 n = glm::dvec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            glm::dvec3 color = glm::dvec3(0.0);
+            double weight = 0.0;
+            for (size_t i = 0; i < directions.size(); i++) {
+                const double nDotL = glm::dot(n, glm::dvec3(directions[i]));
+                if (nDotL > 0.0) {
+                    color += glm::dvec3(scratch[i]) * (nDotL * solidAngles[i]);
+                    weight += nDotL * solidAngles[i];
+                }
+            }
+            row[x] = glm::vec3(color / weight);
+        }
+    });
+    return result;
+}
+
+static Bitmap makeSyntheticEquirect(int width, int height)
+{
+    // Sky gradient with a small, very bright sun so the convolution sees realistic HDR contrast
+    Bitmap bitmap(width, height, 1);
+    const glm::vec3 sunDirection = glm::normalize(glm::vec3(0.3f, 0.5f, 0.8f));
+    // Rows in parallel, the 16K map has 134 million pixels
+    parallelFor(0, height, [&](int y) {
+        const float theta = (float(y) + 0.5f) / float(height) * glm::pi<float>();
+        const std::span<glm::vec3> row = bitmap.getPixels<glm::vec3>(y);
+        for (int x = 0; x < width; x++) {
+            const float phi = (float(x) + 0.5f) / float(width) * glm::two_pi<float>();
+            const glm::vec3 dir = glm::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+            const glm::vec3 sky = glm::mix(glm::vec3(0.9f, 0.8f, 0.7f), glm::vec3(0.2f, 0.4f, 0.9f), dir.z * 0.5f + 0.5f);
+            const float sun = glm::dot(dir, sunDirection) > 0.999f ? 500.0f : 0.0f;
+            row[x] = sky + glm::vec3(sun);
+        }
+    });
+    return bitmap;
+}
+
+// JPEG files of noisy gradients, so that decoding them costs about as much as decoding photographs
+static std::vector<std::string> writeSyntheticTextures(const std::filesystem::path& directory, int count, int size)
+{
+    std::filesystem::create_directories(directory);
+    std::vector<std::string> fileNames;
+    std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 3);
+    uint32_t state = 1;
+    for (int i = 0; i < count; i++) {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                state = state * 1664525u + 1013904223u;
+                uint8_t* pixel = &pixels[(static_cast<size_t>(y) * size + x) * 3];
+                pixel[0] = static_cast<uint8_t>(x * 255 / size + (state >> 28));
+                pixel[1] = static_cast<uint8_t>(y * 255 / size + (state >> 24 & 15));
+                pixel[2] = static_cast<uint8_t>(i * 37 + (state >> 20 & 15));
+            }
+        }
+        fileNames.push_back((directory / ("texture" + std::to_string(i) + ".jpg")).string());
+        stbi_write_jpg(fileNames.back().c_str(), size, size, 3, pixels.data(), 90);
+    }
+    return fileNames;
+}
+
+static std::vector<unsigned int> getThreadCounts()
+{
+    setThreadCount(0);
+    const unsigned int maxThreads = getThreadCount();
+    std::vector<unsigned int> counts;
+    for (unsigned int count = 1; count < maxThreads; count *= 2) {
+        counts.push_back(count);
+    }
+    counts.push_back(maxThreads);
+    return counts;
+}
+
+static size_t getPeakRssBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    // Kilobytes on Linux
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+// Enough for file names: backslashes of Windows paths and quotes
+static std::string escapeJson(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+static bool isBitIdentical(const Bitmap& a, const Bitmap& b)
+{
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight() || a.getDepth() != b.getDepth() || a.getFormat() != b.getFormat()) {
+        return false;
+    }
+    return std::memcmp(a.getData(), b.getData(), a.getByteSize()) == 0;
+}
+
+static float getMaxRelativeError(const Bitmap& reference, const Bitmap& bitmap)
+{
+    float maxError = 0.0f;
+    for (int z = 0; z < reference.getDepth(); z++) {
+        for (int y = 0; y < reference.getHeight(); y++) {
+            for (int x = 0; x < reference.getWidth(); x++) {
+                const glm::vec3 a = reference.getPixel(x, y, z);
+                const glm::vec3 b = bitmap.getPixel(x, y, z);
+                for (int c = 0; c < 3; c++) {
+                    if (a[c] != 0.0f) {
+                        maxError = std::fmax(maxError, std::fabs(b[c] - a[c]) / std::fabs(a[c]));
+                    }
+                }
+            }
+        }
+    }
+    return maxError;
+}
+
+static float getRmsRelativeError(const Bitmap& reference, const Bitmap& bitmap)
+{
+    double sum = 0.0;
+    size_t count = 0;
+    for (int z = 0; z < reference.getDepth(); z++) {
+        for (int y = 0; y < reference.getHeight(); y++) {
+            for (int x = 0; x < reference.getWidth(); x++) {
+                const glm::vec3 a = reference.getPixel(x, y, z);
+                const glm::vec3 b = bitmap.getPixel(x, y, z);
+                for (int c = 0; c < 3; c++) {
+                    if (a[c] != 0.0f) {
+                        const double error = (double(b[c]) - double(a[c])) / double(a[c]);
+                        sum += error * error;
+                        count++;
+                    }
+                }
+            }
+        }
+    }
+    return count > 0 ? float(std::sqrt(sum / double(count))) : 0.0f;
+}
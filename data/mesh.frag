@@ -1,4 +1,5 @@
 #version 460 core
+#extension GL_ARB_bindless_texture : require
 
 struct PerVertex {
     vec2 uv;
@@ -14,16 +15,32 @@ layout (std140, binding = 0) uniform PerFrameData {
     uniform int isWireframe;
 };
 
-layout (binding = 0) uniform sampler2D texAlbedo;
-layout (binding = 1) uniform sampler2D texMetallicRoughness;
-layout (binding = 2) uniform sampler2D texAmbientOcclusion;
-layout (binding = 3) uniform sampler2D texEmissive;
-layout (binding = 4) uniform sampler2D texNormals;
+// Irradiance as L2 spherical harmonics, used instead of texEnvironmentIrradiance when useIrradianceSH is set
+layout (std140, binding = 1) uniform IrradianceData {
+    uniform vec4 irradianceSH[9];
+    uniform int useIrradianceSH;
+};
+
+// Textures are bindless handles: albedo, metallic roughness, ambient occlusion, emissive, normals.
+// Albedo and emissive are sRGB textures, so they are sampled as linear colors. Normal maps only store x and y.
+struct Material {
+    vec4 baseColorFactor;
+    vec4 emissiveFactor;
+    float metallicFactor;
+    float roughnessFactor;
+    uvec2 textures[5];
+};
+
+layout (std430, binding = 3) readonly buffer MaterialBuffer {
+    Material materials[];
+};
+
 layout (binding = 5) uniform samplerCube texEnvironment;
 layout (binding = 6) uniform samplerCube texEnvironmentIrradiance;
 layout (binding = 7) uniform sampler2D texBrdfLut;
 
 layout (location = 0) in PerVertex vtx;
+layout (location = 3) flat in uint material;
 
 layout (location = 0) out vec4 out_FragColor;
 
@@ -50,11 +67,18 @@ struct PBRInfo
 
 const float M_PI = 3.141592653589793;
 
-vec4 SRGBtoLINEAR(vec4 srgbIn)
+// Evaluates the cosine-convolved SH coefficients (already divided by pi) for normal n
+vec3 irradianceFromSH(vec3 n)
 {
-	vec3 linOut = pow(srgbIn.xyz, vec3(2.2));
-
-	return vec4(linOut, srgbIn.a);
+	return irradianceSH[0].rgb * 0.282095
+		+ irradianceSH[1].rgb * (0.488603 * n.y)
+		+ irradianceSH[2].rgb * (0.488603 * n.z)
+		+ irradianceSH[3].rgb * (0.488603 * n.x)
+		+ irradianceSH[4].rgb * (1.092548 * n.x * n.y)
+		+ irradianceSH[5].rgb * (1.092548 * n.y * n.z)
+		+ irradianceSH[6].rgb * (0.315392 * (3.0 * n.z * n.z - 1.0))
+		+ irradianceSH[7].rgb * (1.092548 * n.x * n.z)
+		+ irradianceSH[8].rgb * (0.546274 * (n.x * n.x - n.y * n.y));
 }
 
 // Calculation of the lighting contribution from an optional Image Based Light source
@@ -68,7 +92,13 @@ vec3 getIBLContribution(PBRInfo pbrInputs, vec3 n, vec3 reflection)
 	//vec3 cm = vec3(1.0, -1.0, -1.0);
 	vec3 cm = vec3(1.0, 1.0, 1.0);
 	// HDR envmaps are already linear
-	vec3 diffuseLight = texture(texEnvironmentIrradiance, n.xyz * cm).rgb;
+	vec3 diffuseLight;
+	if (useIrradianceSH != 0) {
+		diffuseLight = max(irradianceFromSH(n.xyz * cm), vec3(0.0));
+	}
+	else {
+		diffuseLight = texture(texEnvironmentIrradiance, n.xyz * cm).rgb;
+	}
 	vec3 specularLight = textureLod(texEnvironment, reflection.xyz * cm, lod).rgb;
 
 	vec3 diffuse = diffuseLight * pbrInputs.diffuseColor;
@@ -226,20 +256,22 @@ mat3 cotangentFrame( vec3 N, vec3 p, vec2 uv )
 	return mat3(T * invmax, B * invmax, N);
 }
 
-vec3 perturbNormal(vec3 n, vec3 v, vec3 normalSample, vec2 uv)
+vec3 perturbNormal(vec3 n, vec3 v, vec2 normalSample, vec2 uv)
 {
-	vec3 map = normalize(2.0 * normalSample - vec3(1.0));
+	vec2 xy = 2.0 * normalSample - vec2(1.0);
+	vec3 map = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
 	mat3 TBN = cotangentFrame(n, v, uv);
 	return normalize(TBN * map);
 }
 
 void main()
 {
-    vec4 Kd = texture(texAlbedo, vtx.uv);
-    vec4 Kao = texture(texAmbientOcclusion, vtx.uv);
-    vec4 Ke = texture(texEmissive, vtx.uv);
-	vec4 mrSample = texture(texMetallicRoughness, vtx.uv);
-	vec3 normalSample = texture(texNormals, vtx.uv).xyz;
+    Material mat = materials[material];
+    vec4 Kd = texture(sampler2D(mat.textures[0]), vtx.uv) * mat.baseColorFactor;
+    vec4 Kao = texture(sampler2D(mat.textures[2]), vtx.uv);
+    vec4 Ke = texture(sampler2D(mat.textures[3]), vtx.uv);
+	vec4 mrSample = texture(sampler2D(mat.textures[1]), vtx.uv) * vec4(1.0, mat.roughnessFactor, mat.metallicFactor, 1.0);
+	vec2 normalSample = texture(sampler2D(mat.textures[4]), vtx.uv).xy;
     
 	PBRInfo pbrInputs;
     vec3 n = normalize(vtx.normal);
@@ -247,6 +279,6 @@ void main()
     vec3 color = calculatePBRInputsMetallicRoughness(Kd, n, cameraPos.xyz, vtx.worldPos, mrSample, pbrInputs);
     color += calculatePBRLightContribution(pbrInputs, normalize(vec3(-1.0, -1.0, -1.0)), vec3(1.0));
     color = color * (Kao.r < 0.01 ? 1.0 : Kao.r);
-    color = pow(SRGBtoLINEAR(Ke).rgb + color, vec3(1.0 / 2.2));
+    color = pow(Ke.rgb * mat.emissiveFactor.rgb + color, vec3(1.0 / 2.2));
     out_FragColor = isWireframe > 0 ? vec4(1.0) : vec4(color, 1.0);
 }
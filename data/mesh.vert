@@ -14,18 +14,30 @@ layout (std140, binding = 0) uniform PerFrameData {
     uniform int isWireframe;
 };
 
+struct DrawData {
+    mat4 transform;
+    uint material;
+};
+
+layout (std430, binding = 2) readonly buffer DrawDataBuffer {
+    DrawData drawData[];
+};
+
 layout (location = 0) in vec3 pos;
 layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 uv;
 
 layout (location = 0) out PerVertex vtx;
+layout (location = 3) flat out uint material;
 
 void main()
 {
-    mat4 mvp = proj * view * model;
+    mat4 modelTransform = model * drawData[gl_DrawID].transform;
+    mat4 mvp = proj * view * modelTransform;
     gl_Position = mvp * vec4(pos, 1.0);
-    mat3 normalMatrix = mat3(transpose(inverse(model)));
+    mat3 normalMatrix = mat3(transpose(inverse(modelTransform)));
     vtx.uv = uv;
     vtx.normal = normalize(normalMatrix * normal); //normal * normalMatrix;
-    vtx.worldPos = (model * vec4(pos, 1.0)).xyz;
+    vtx.worldPos = (modelTransform * vec4(pos, 1.0)).xyz;
+    material = drawData[gl_DrawID].material;
 }
@@ -1,27 +1,222 @@
+#include <algorithm>
 #include <stdexcept>
+#include <cassert>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <type_traits>
 #include <stb_image.h>
-#include <stb_image_resize2.h>
 #include <glm/ext.hpp>
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
 
 #include "cubemap.h"
 
+#include "block_compression.h"
+#include "hdr_file.h"
+#include "parallel.h"
+
 #include "bitmap.h"
 
+// Monte Carlo sample directions and the radiance they hit, stored as structure of arrays
+// and zero-padded to a multiple of 8 lanes (a zero direction never passes the nDotL test)
+struct IrradianceSamples {
+    int count = 0;
+    std::vector<float> dirX;
+    std::vector<float> dirY;
+    std::vector<float> dirZ;
+    std::vector<float> red;
+    std::vector<float> green;
+    std::vector<float> blue;
+};
+
+// Bilinear footprint of a vertical cross texel in the equirectangular map
+struct EquirectangularTap {
+    int u1;
+    int v1;
+    int u2;
+    int v2;
+    float s;
+    float t;
+};
+
+// Precomputed taps for every cubemap face texel (in face layout order) of an equirect of a given size.
+// Each tap stores the top-left source pixel index; the flag bits mark taps clamped at the right or bottom edge.
+struct CubeMapSamplingTable {
+    static constexpr uint32_t noStepRight = 1u << 31;
+    static constexpr uint32_t noStepDown = 1u << 30;
+    static constexpr uint32_t indexMask = noStepDown - 1;
+
+    int srcWidth = 0;
+    int srcHeight = 0;
+    std::vector<uint32_t> taps;
+    std::vector<glm::vec2> weights;
+};
+
+// One GGX importance sample of a prefiltered mip level, relative to the reflection direction
+struct PrefilterSample {
+    // Tangent space, z points along the reflection direction
+    glm::vec3 direction;
+    // nDotL
+    float weight;
+    // Source pyramid level that matches the solid angle of the sample
+    float lod;
+};
+
+// Working image of the resampler: four float channels per pixel, alpha being 1 for RGB formats
+struct ResampleImage {
+    int width = 0;
+    int height = 0;
+    std::vector<float> pixels;
+
+    float* getRow(int y) { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+    const float* getRow(int y) const { return pixels.data() + static_cast<size_t>(y) * width * 4; }
+};
+
+// Normalized filter taps of every output texel along one axis; output i uses taps [offsets[i], offsets[i + 1]).
+// Indices point into the source, or into a copy of it that is padded by the same amount on every side.
+struct ResampleTaps {
+    std::vector<int> offsets;
+    std::vector<int> indices;
+    std::vector<float> weights;
+};
+
+static constexpr float kaiserRadius = 3.0f;
+static constexpr float kaiserAlpha = 4.0f;
+
+// For every cubemap face, the vertical cross face it is copied from by
+// convertVerticalCrossToCubeMapFaces, and whether that copy is rotated by 180 degrees
+static constexpr struct {
+    CubemapFace crossFace;
+    bool rotated;
+} cubeMapFaceSources[6] = {
+    { CubemapFace::NegativeX, false },
+    { CubemapFace::NegativeY, false },
+    { CubemapFace::PositiveZ, true },
+    { CubemapFace::NegativeZ, true },
+    { CubemapFace::PositiveX, true },
+    { CubemapFace::PositiveY, false }
+};
+
+template<typename Function>
+static void visitFormat(BitmapFormat format, Function&& function);
+template<BitmapFormat Format>
+static glm::vec3 loadPixel(const uint8_t* pixel);
+template<BitmapFormat Format>
+static void storePixel(uint8_t* pixel, const glm::vec3& color);
+template<BitmapFormat SrcFormat, BitmapFormat DstFormat>
+static void gatherCubeMapFaces(const CubeMapSamplingTable& table, const uint8_t* src, uint8_t* dst);
+static EquirectangularTap getEquirectangularTap(int x, int y, CubemapFace face, int faceSize, int srcWidth, int srcHeight);
+static EquirectangularTap getCubeMapFaceTap(int face, int x, int y, int faceSize, int srcWidth, int srcHeight);
+template<BitmapFormat Format>
+static glm::vec3 sampleEquirectangularRows(const EquirectangularTap& tap, const uint8_t* row1, const uint8_t* row2);
+template<BitmapFormat Format>
+static glm::vec3 sampleEquirectangularMap(const Bitmap& bitmap, int x, int y, CubemapFace face, int faceSize);
+static std::shared_ptr<const CubeMapSamplingTable> getCubeMapSamplingTable(int srcWidth, int srcHeight);
+static glm::vec3 getCubeMapTexelDirection(int face, int x, int y, int faceSize);
+static int getCubeMapFaceCoords(const glm::vec3& direction, glm::vec2& uv);
+static glm::vec3 sampleCubeMap(const Bitmap& faces, const glm::vec3& direction);
+static std::vector<PrefilterSample> buildPrefilterSamples(float roughness, int numSamples, int srcFaceSize, int numSrcLevels);
 static float radicalInverseVdC(uint32_t bits);
 static glm::vec2 hammersley2d(uint32_t i, uint32_t N);
+static IrradianceSamples buildIrradianceSamples(const glm::vec3* scratch, int srcW, int srcH, int numMonteCarloSamples);
+static glm::vec3 integrateIrradiance(const IrradianceSamples& samples, const glm::vec3& n);
+static glm::vec3 integrateIrradianceCosineWeighted(const std::vector<glm::vec3>& directions, const glm::vec3* src, int srcW, int srcH, const glm::vec3& n);
+static void decodeHdrScanline(const HdrFile& hdr, int y, std::span<uint8_t> row, BitmapFormat format, std::vector<uint8_t>& scratch);
+static bool exceedsDecodedByteSize(int width, int height, size_t memoryBudget);
+static int getDownsampleFactor(int width, int maxWidth);
+static void downsampleRows(const Bitmap& src, int srcY, int factor, Bitmap& dst);
+static std::array<glm::dvec3, 9> projectRowOntoSH(std::span<const uint8_t> row, BitmapFormat format, int width, int y, int height);
+static std::array<glm::vec3, 9> reduceIrradianceSH(const std::vector<std::array<glm::dvec3, 9>>& rowSums);
+static void encodeBlocks(const Bitmap& src, Bitmap& dst);
+static void decodeBlocks(const Bitmap& src, Bitmap& dst);
+static float getFilterRadius(ResampleFilter filter);
+static float evaluateKaiser(float x);
+static ResampleTaps buildResampleTaps(int srcSize, int dstSize, ResampleFilter filter, ResampleEdge edge, int padding);
+static void loadResampleRow(const Bitmap& bitmap, int x, int y, int z, int count, float* dst);
+static ResampleImage loadResampleImage(const Bitmap& bitmap, int z);
+static void storeResampleImage(const ResampleImage& image, Bitmap& bitmap, int z);
+static void convertResampleImageColors(ResampleImage& image, float (*convert)(float));
+static void normalizeResampleImage(ResampleImage& image);
+static float convertSRGBToLinear(float value);
+static float convertLinearToSRGB(float value);
+static ResampleImage padCubeMapFace(const Bitmap& faces, int face, int padding);
+static ResampleImage resampleImage(const ResampleImage& src, int width, int height, const ResampleTaps& tapsX, const ResampleTaps& tapsY);
+static void addWeightedRow(float* dst, const float* src, float weight, size_t count);
+static void filterRow(const float* src, const ResampleTaps& taps, float* dst, int width);
 
-Bitmap::Bitmap(std::string_view fileName) : depth(1)
+Bitmap::Bitmap(std::string_view fileName, BitmapFormat format) : depth(1), format(format)
 {
-    std::string fileNameString(fileName);
-    const float* imageData = stbi_loadf(fileNameString.c_str(), &width, &height, nullptr, 3);
+    if (isBlockCompressed(format)) {
+        *this = convertFormat(Bitmap(fileName, getUncompressedFormat(format)), format);
+        return;
+    }
+    MappedFile file(fileName);
+    if (HdrFile::hasSignature(file)) {
+        // Radiance files are decoded natively, bands of scanlines in parallel straight into the pixel buffer
+        const HdrFile hdr(std::move(file));
+        width = hdr.getWidth();
+        height = hdr.getHeight();
+        data.resize(static_cast<size_t>(width) * height * depth * getBytesPerPixel(format));
+        constexpr int bandHeight = 16;
+        parallelFor(0, (height + bandHeight - 1) / bandHeight, [&](int band) {
+            std::vector<uint8_t> scratch;
+            for (int y = band * bandHeight; y < std::min((band + 1) * bandHeight, height); y++) {
+                decodeHdrScanline(hdr, y, getRow(y), format, scratch);
+            }
+        });
+        return;
+    }
+
+    // Everything else goes through stb_image
+    const std::string fileNameString(fileName);
+    if (file.getSize() > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("Image file too large: " + fileNameString);
+    }
+    if (format == BitmapFormat::RGBA8) {
+        // Kept as 8-bit, with alpha
+        uint8_t* imageData = stbi_load_from_memory(file.getData(), static_cast<int>(file.getSize()), &width, &height, nullptr, 4);
+        if (!imageData) {
+            throw std::runtime_error("Could not load image data: " + fileNameString);
+        }
+        data.assign(imageData, imageData + static_cast<size_t>(width) * height * 4);
+        stbi_image_free(imageData);
+        return;
+    }
+    const float* imageData = stbi_loadf_from_memory(file.getData(), static_cast<int>(file.getSize()), &width, &height, nullptr, 3);
     if (!imageData) {
         throw std::runtime_error("Could not load image data: " + fileNameString);
     }
-    data.assign(imageData, imageData + width * height * depth * 3);
+    const size_t bytesPerPixel = getBytesPerPixel(format);
+    data.resize(static_cast<size_t>(width) * height * depth * bytesPerPixel);
+    if (format == BitmapFormat::RGB32F) {
+        std::memcpy(data.data(), imageData, data.size());
+    }
+    else {
+        // Encode straight from the decoder output, so no full-size float copy is kept around
+        visitFormat(format, [&](auto dstFormat) {
+            parallelFor(0, height, [&](int y) {
+                const float* src = imageData + static_cast<size_t>(y) * width * 3;
+                const std::span<uint8_t> row = getRow(y);
+                for (int x = 0; x < width; x++) {
+                    const glm::vec3 color(src[x * 3 + 0], src[x * 3 + 1], src[x * 3 + 2]);
+                    storePixel<decltype(dstFormat)::value>(&row[x * bytesPerPixel], color);
+                }
+            });
+        });
+    }
     stbi_image_free((void*)imageData);
 }
 
-Bitmap::Bitmap(int width, int height, int depth) : width(width), height(height), depth(depth), data(static_cast<size_t>(width * height * depth * 3))
+Bitmap::Bitmap(int width, int height, int depth, BitmapFormat format)
+    : width(width)
+    , height(height)
+    , depth(depth)
+    , format(format)
+    , data(getLayerByteSize(format, width, height) * depth)
 {
 }
 
@@ -29,6 +224,7 @@ Bitmap::Bitmap(Bitmap&& other) noexcept
     : width(other.width)
     , height(other.height)
     , depth(other.depth)
+    , format(other.format)
     , data(std::move(other.data))
 {
     other.width = 0;
@@ -45,23 +241,76 @@ Bitmap& Bitmap::operator=(Bitmap&& other) noexcept
         other.height = 0;
         depth = other.depth;
         other.depth = 0;
+        format = other.format;
         data = std::move(other.data);
     }
     return *this;
 }
 
+BitmapView Bitmap::getView(int x, int y, int width, int height, int z)
+{
+    assert(x >= 0 && y >= 0 && x + width <= this->width && y + height <= this->height && z >= 0 && z < depth);
+    const size_t rowStride = static_cast<size_t>(this->width) * getBytesPerPixel(format);
+    uint8_t* origin = data.data() + (static_cast<size_t>(z) * this->height + y) * rowStride + x * getBytesPerPixel(format);
+    return BitmapView{ origin, width, height, rowStride, format };
+}
+
+ConstBitmapView Bitmap::getView(int x, int y, int width, int height, int z) const
+{
+    const BitmapView view = const_cast<Bitmap*>(this)->getView(x, y, width, height, z);
+    return ConstBitmapView{ view.data, view.width, view.height, view.rowStride, view.format };
+}
+
 glm::vec3 Bitmap::getPixel(int x, int y, int z) const
 {
-    int index = (x + y * width + z * width * height) * 3;
-    return glm::vec3(data[index], data[index + 1], data[index + 2]);
+    const uint8_t* pixel = &getRow(y, z)[x * getBytesPerPixel(format)];
+    glm::vec3 color;
+    visitFormat(format, [&](auto srcFormat) {
+        color = loadPixel<decltype(srcFormat)::value>(pixel);
+    });
+    return color;
 }
 
 void Bitmap::setPixel(int x, int y, int z, const glm::vec3& color)
 {
-    int index = (x + y * width + z * width * height) * 3;
-    data[index + 0] = color.r;
-    data[index + 1] = color.g;
-    data[index + 2] = color.b;
+    uint8_t* pixel = &getRow(y, z)[x * getBytesPerPixel(format)];
+    visitFormat(format, [&](auto dstFormat) {
+        storePixel<decltype(dstFormat)::value>(pixel, color);
+    });
+}
+
+Bitmap Bitmap::convertFormat(const Bitmap& bitmap, BitmapFormat format)
+{
+    Bitmap result(bitmap.getWidth(), bitmap.getHeight(), bitmap.getDepth(), format);
+    if (format == bitmap.getFormat()) {
+        // Plain copy, which also keeps the alpha of RGBA8
+        std::memcpy(result.getData(), bitmap.getData(), bitmap.getByteSize());
+        return result;
+    }
+    if (isBlockCompressed(format)) {
+        encodeBlocks(bitmap, result);
+        return result;
+    }
+    if (isBlockCompressed(bitmap.getFormat())) {
+        decodeBlocks(bitmap, result);
+        return result;
+    }
+    const size_t srcBytesPerPixel = getBytesPerPixel(bitmap.getFormat());
+    const size_t dstBytesPerPixel = getBytesPerPixel(format);
+    const int height = bitmap.getHeight();
+    visitFormat(bitmap.getFormat(), [&](auto srcFormat) {
+        visitFormat(format, [&](auto dstFormat) {
+            parallelFor(0, height * bitmap.getDepth(), [&](int row) {
+                const std::span<const uint8_t> src = bitmap.getRow(row % height, row / height);
+                const std::span<uint8_t> dst = result.getRow(row % height, row / height);
+                for (int x = 0; x < bitmap.getWidth(); x++) {
+                    const glm::vec3 color = loadPixel<decltype(srcFormat)::value>(&src[x * srcBytesPerPixel]);
+                    storePixel<decltype(dstFormat)::value>(&dst[x * dstBytesPerPixel], color);
+                }
+            });
+        });
+    });
+    return result;
 }
 
 Bitmap Bitmap::convertEquirectangularMapToVerticalCross(const Bitmap& bitmap)
@@ -79,122 +328,703 @@ Bitmap Bitmap::convertEquirectangularMapToVerticalCross(const Bitmap& bitmap)
         glm::ivec2(faceSize, 0),
         glm::ivec2(faceSize, faceSize * 2)
     };
-    const int clampWidth = bitmap.getWidth() - 1;
-    const int clampHeight = bitmap.getHeight() - 1;
 
-    for (int face = 0; face < 6; face++) {
-        for (int x = 0; x < faceSize; x++) {
+    visitFormat(bitmap.getFormat(), [&](auto srcFormat) {
+        for (int face = 0; face < 6; face++) {
+            const BitmapView view = result.getView(faceOffsets[face].x, faceOffsets[face].y, faceSize, faceSize);
             for (int y = 0; y < faceSize; y++) {
-                const glm::vec3 p = Cubemap::faceCoordsToXYZ(x, y, static_cast<CubemapFace>(face), faceSize);
-                const float r = hypot(p.x, p.y);
-                const float theta = atan2(p.y, p.x);
-                const float phi = atan2(p.z, r);
-                constexpr float pi = glm::pi<float>();
-
-                const float uf = float(2.0f * faceSize * (theta + pi) / pi);
-                const float vf = float(2.0f * faceSize * (pi / 2.0f - phi) / pi);
-
-                const int u1 = glm::clamp(int(floor(uf)), 0, clampWidth);
-                const int v1 = glm::clamp(int(floor(vf)), 0, clampHeight);
-                const int u2 = glm::clamp(u1 + 1, 0, clampWidth);
-                const int v2 = glm::clamp(v1 + 1, 0, clampHeight);
-
-                const float s = uf - u1;
-                const float t = vf - v1;
-                const glm::vec3 a = bitmap.getPixel(u1, v1, 0);
-                const glm::vec3 b = bitmap.getPixel(u2, v1, 0);
-                const glm::vec3 c = bitmap.getPixel(u1, v2, 0);
-                const glm::vec3 d = bitmap.getPixel(u2, v2, 0);
-
-                // Biliniear interpolation
-                const glm::vec3 color = a * (1 - s) * (1 - t) + b * s * (1 - t) + c * (1 - s) * t + d * s * t;
-                result.setPixel(x + faceOffsets[face].x, y + faceOffsets[face].y, 0, color);
+                const std::span<glm::vec3> row = view.getPixels<glm::vec3>(y);
+                for (int x = 0; x < faceSize; x++) {
+                    row[x] = sampleEquirectangularMap<decltype(srcFormat)::value>(bitmap, x, y, static_cast<CubemapFace>(face), faceSize);
+                }
             }
         }
-    }
+    });
 
     return result;
 }
 
 Bitmap Bitmap::convertVerticalCrossToCubeMapFaces(const Bitmap& bitmap)
 {
+    // Position of each face in the cross in units of faces; rotated faces are turned by 180 degrees
+    static const struct {
+        int x;
+        int y;
+        bool rotated;
+    } crossFaces[6] = {
+        { 0, 1, false },
+        { 2, 1, false },
+        { 1, 0, true },
+        { 1, 2, true },
+        { 1, 3, true },
+        { 1, 1, false }
+    };
+
     const int faceWidth = bitmap.getWidth() / 3;
     const int faceHeight = bitmap.getHeight() / 4;
-    Bitmap cubemap(faceWidth, faceHeight, 6);
+    const size_t bytesPerPixel = getBytesPerPixel(bitmap.getFormat());
+    Bitmap cubemap(faceWidth, faceHeight, 6, bitmap.getFormat());
     for (int face = 0; face < 6; face++) {
+        const ConstBitmapView src = bitmap.getView(crossFaces[face].x * faceWidth, crossFaces[face].y * faceHeight, faceWidth, faceHeight);
         for (int y = 0; y < faceHeight; y++) {
+            const std::span<uint8_t> dstRow = cubemap.getRow(y, face);
+            if (!crossFaces[face].rotated) {
+                std::memcpy(dstRow.data(), src.getRow(y).data(), dstRow.size());
+                continue;
+            }
+            const std::span<const uint8_t> srcRow = src.getRow(faceHeight - y - 1);
             for (int x = 0; x < faceWidth; x++) {
-                int srcX = 0;
-                int srcY = 0;
-                switch (static_cast<CubemapFace>(face)) {
-                case CubemapFace::PositiveX:
-                    srcX = x;
-                    srcY = faceHeight + y;
-                    break;
-                case CubemapFace::NegativeX:
-                    srcX = 2 * faceWidth + x;
-                    srcY = faceHeight + y;
-                    break;
-                case CubemapFace::PositiveY:
-                    srcX = 2 * faceWidth - x - 1;
-                    srcY = faceHeight - y - 1;
-                    break;
-                case CubemapFace::NegativeY:
-                    srcX = 2 * faceWidth - x - 1;
-                    srcY = 3 * faceHeight - y - 1;
-                    break;
-                case CubemapFace::PositiveZ:
-                    srcX = 2 * faceWidth - x - 1;
-                    srcY = bitmap.getHeight() - y - 1;
-                    break;
-                case CubemapFace::NegativeZ:
-                    srcX = faceWidth + x;
-                    srcY = faceHeight + y;
-                    break;
+                std::memcpy(&dstRow[x * bytesPerPixel], &srcRow[(faceWidth - x - 1) * bytesPerPixel], bytesPerPixel);
+            }
+        }
+    }
+    return cubemap;
+}
+
+Bitmap Bitmap::convertEquirectangularMapToCubeMapFaces(const Bitmap& bitmap, BitmapFormat format)
+{
+    const int faceSize = bitmap.getWidth() / 4;
+    Bitmap cubemap(faceSize, faceSize, 6, format);
+
+    // With a cached table, the conversion is a plain gather without any trigonometry
+    const std::shared_ptr<const CubeMapSamplingTable> table = getCubeMapSamplingTable(bitmap.getWidth(), bitmap.getHeight());
+    if (table) {
+        visitFormat(bitmap.getFormat(), [&](auto srcFormat) {
+            visitFormat(format, [&](auto dstFormat) {
+                gatherCubeMapFaces<decltype(srcFormat)::value, decltype(dstFormat)::value>(*table, bitmap.data.data(), cubemap.data.data());
+            });
+        });
+        return cubemap;
+    }
+
+    // 32x32 texels are at most 12 KB of output per tile, which keeps a tile and the equirect rows it reads in L2
+    constexpr int tileSize = 32;
+    const int tilesPerRow = (faceSize + tileSize - 1) / tileSize;
+    const int tilesPerFace = tilesPerRow * tilesPerRow;
+    const size_t bytesPerPixel = getBytesPerPixel(format);
+    visitFormat(bitmap.getFormat(), [&](auto srcFormat) {
+        visitFormat(format, [&](auto dstFormat) {
+            parallelFor(0, 6 * tilesPerFace, [&](int tile) {
+                const int face = tile / tilesPerFace;
+                const int tileX = (tile % tilesPerFace) % tilesPerRow * tileSize;
+                const int tileY = (tile % tilesPerFace) / tilesPerRow * tileSize;
+                const CubemapFace crossFace = cubeMapFaceSources[face].crossFace;
+                const bool rotated = cubeMapFaceSources[face].rotated;
+                for (int y = tileY; y < std::min(tileY + tileSize, faceSize); y++) {
+                    const std::span<uint8_t> row = cubemap.getRow(y, face);
+                    for (int x = tileX; x < std::min(tileX + tileSize, faceSize); x++) {
+                        const int crossX = rotated ? faceSize - x - 1 : x;
+                        const int crossY = rotated ? faceSize - y - 1 : y;
+                        const glm::vec3 color = sampleEquirectangularMap<decltype(srcFormat)::value>(bitmap, crossX, crossY, crossFace, faceSize);
+                        storePixel<decltype(dstFormat)::value>(&row[x * bytesPerPixel], color);
+                    }
                 }
-                cubemap.setPixel(x, y, face, bitmap.getPixel(srcX, srcY, 0));
+            });
+        });
+    });
+    return cubemap;
+}
+
+Bitmap Bitmap::loadEquirectangularMapAsCubeMapFaces(std::string_view fileName, size_t memoryBudget, BitmapFormat format)
+{
+    MappedFile file(fileName);
+    if (!HdrFile::hasSignature(file)) {
+        return convertEquirectangularMapToCubeMapFaces(Bitmap(fileName), format);
+    }
+    const HdrFile hdr(std::move(file));
+    const int width = hdr.getWidth();
+    const int height = hdr.getHeight();
+    if (!exceedsDecodedByteSize(width, height, memoryBudget)) {
+        return convertEquirectangularMapToCubeMapFaces(Bitmap(fileName), format);
+    }
+
+    const int faceSize = width / 4;
+    Bitmap cubemap(faceSize, faceSize, 6, format);
+    constexpr int tileSize = 32;
+    const int tilesPerRow = (faceSize + tileSize - 1) / tileSize;
+    const int tilesPerFace = tilesPerRow * tilesPerRow;
+    const size_t bytesPerPixel = getBytesPerPixel(format);
+    auto forEachTexel = [&](int tile, auto&& function) {
+        const int face = tile / tilesPerFace;
+        const int tileX = (tile % tilesPerFace) % tilesPerRow * tileSize;
+        const int tileY = (tile % tilesPerFace) / tilesPerRow * tileSize;
+        for (int y = tileY; y < std::min(tileY + tileSize, faceSize); y++) {
+            for (int x = tileX; x < std::min(tileX + tileSize, faceSize); x++) {
+                function(face, x, y, getCubeMapFaceTap(face, x, y, faceSize, width, height));
+            }
+        }
+    };
+
+    // First and last source row each tile samples from, so a band only visits the tiles that overlap it.
+    // Widened by a row, since only the band pass decides which band writes a texel.
+    std::vector<glm::ivec2> tileRows(6 * static_cast<size_t>(tilesPerFace));
+    parallelFor(0, 6 * tilesPerFace, [&](int tile) {
+        glm::ivec2 rows(height, 0);
+        forEachTexel(tile, [&](int, int, int, const EquirectangularTap& tap) {
+            rows = glm::ivec2(std::min(rows.x, tap.v1), std::max(rows.y, tap.v1));
+        });
+        tileRows[tile] = glm::ivec2(rows.x - 1, rows.y + 1);
+    });
+
+    // Bands are kept in RGBE like the file, with one more row for the lower bilinear taps of their last row.
+    // Each texel is written by the band that contains the upper row of its taps, from the same source values
+    // and with the same arithmetic as the in-memory conversion.
+    const size_t rowSize = static_cast<size_t>(width) * getBytesPerPixel(BitmapFormat::RGBE8);
+    const int bandHeight = static_cast<int>(std::clamp<size_t>(memoryBudget / rowSize, 2, height + 1)) - 1;
+    Bitmap band;
+    std::vector<int> bandTiles;
+    for (int y0 = 0; y0 < height; y0 += bandHeight) {
+        const int y1 = std::min(y0 + bandHeight, height);
+        const int rows = std::min(y1 + 1, height) - y0;
+        if (band.getHeight() != rows) {
+            band = Bitmap(width, rows, 1, BitmapFormat::RGBE8);
+        }
+        parallelFor(0, rows, [&](int row) {
+            hdr.decodeScanline(y0 + row, band.getRow(row));
+        });
+        bandTiles.clear();
+        for (int tile = 0; tile < 6 * tilesPerFace; tile++) {
+            if (tileRows[tile].x < y1 && tileRows[tile].y >= y0) {
+                bandTiles.push_back(tile);
             }
         }
+        visitFormat(format, [&](auto dstFormat) {
+            parallelFor(0, static_cast<int>(bandTiles.size()), [&](int i) {
+                forEachTexel(bandTiles[i], [&](int face, int x, int y, const EquirectangularTap& tap) {
+                    if (tap.v1 >= y0 && tap.v1 < y1) {
+                        const glm::vec3 color = sampleEquirectangularRows<BitmapFormat::RGBE8>(
+                            tap, band.getRow(tap.v1 - y0).data(), band.getRow(tap.v2 - y0).data());
+                        storePixel<decltype(dstFormat)::value>(&cubemap.getRow(y, face)[x * bytesPerPixel], color);
+                    }
+                });
+            });
+        });
     }
     return cubemap;
 }
 
-Bitmap Bitmap::convertDiffuseToIrradiance(const Bitmap& input, int srcW, int srcH, int dstW, int dstH, int numMonteCarloSamples)
+bool Bitmap::exceedsMemoryBudget(std::string_view fileName, size_t memoryBudget)
+{
+    MappedFile file(fileName);
+    if (!HdrFile::hasSignature(file)) {
+        return false;
+    }
+    const HdrFile hdr(std::move(file));
+    return exceedsDecodedByteSize(hdr.getWidth(), hdr.getHeight(), memoryBudget);
+}
+
+Bitmap Bitmap::downsample(Bitmap bitmap, int maxWidth)
+{
+    const int factor = getDownsampleFactor(bitmap.getWidth(), maxWidth);
+    if (factor == 1) {
+        return bitmap;
+    }
+    Bitmap result((bitmap.getWidth() + factor - 1) / factor, (bitmap.getHeight() + factor - 1) / factor, 1);
+    downsampleRows(bitmap, 0, factor, result);
+    return result;
+}
+
+Bitmap Bitmap::loadDownsampled(std::string_view fileName, int maxWidth)
+{
+    MappedFile file(fileName);
+    if (!HdrFile::hasSignature(file)) {
+        return downsample(Bitmap(fileName), maxWidth);
+    }
+    const HdrFile hdr(std::move(file));
+    const int factor = getDownsampleFactor(hdr.getWidth(), maxWidth);
+    if (factor == 1) {
+        return Bitmap(fileName);
+    }
+    // Bands of whole blocks, so every reduced row is computed from one band
+    Bitmap result((hdr.getWidth() + factor - 1) / factor, (hdr.getHeight() + factor - 1) / factor, 1);
+    loadBands(fileName, factor * std::max(1, 64 / factor), BitmapFormat::RGB32F, [&](const Bitmap& band, int y, int) {
+        downsampleRows(band, y, factor, result);
+    });
+    return result;
+}
+
+Bitmap Bitmap::resample(const Bitmap& bitmap, int width, int height, ResampleFilter filter, ResampleEdge edgeX, ResampleEdge edgeY)
+{
+    const ResampleTaps tapsX = buildResampleTaps(bitmap.getWidth(), width, filter, edgeX, 0);
+    const ResampleTaps tapsY = buildResampleTaps(bitmap.getHeight(), height, filter, edgeY, 0);
+    Bitmap result(width, height, bitmap.getDepth(), bitmap.getFormat());
+    for (int z = 0; z < bitmap.getDepth(); z++) {
+        storeResampleImage(resampleImage(loadResampleImage(bitmap, z), width, height, tapsX, tapsY), result, z);
+    }
+    return result;
+}
+
+std::vector<Bitmap> Bitmap::generateMips(const Bitmap& bitmap, ResampleFilter filter, BitmapFormat format, MipContent content)
+{
+    if (isBlockCompressed(format)) {
+        std::vector<Bitmap> levels = generateMips(bitmap, filter, getUncompressedFormat(format), content);
+        for (Bitmap& level : levels) {
+            level = convertFormat(level, format);
+        }
+        return levels;
+    }
+    std::vector<Bitmap> levels;
+    levels.push_back(convertFormat(bitmap, format));
+    // Each level is filtered from the float image of the one above, so 8-bit levels are quantized only once.
+    // The float images stay linear and unnormalized, so they remain averages of the input.
+    std::vector<ResampleImage> images;
+    for (int z = 0; z < bitmap.getDepth(); z++) {
+        images.push_back(loadResampleImage(bitmap, z));
+        if (content == MipContent::SRGB) {
+            convertResampleImageColors(images.back(), convertSRGBToLinear);
+        }
+    }
+    while (levels.back().getWidth() > 1 || levels.back().getHeight() > 1) {
+        const int srcWidth = levels.back().getWidth();
+        const int srcHeight = levels.back().getHeight();
+        const int width = std::max(srcWidth / 2, 1);
+        const int height = std::max(srcHeight / 2, 1);
+        const ResampleTaps tapsX = buildResampleTaps(srcWidth, width, filter, ResampleEdge::Clamp, 0);
+        const ResampleTaps tapsY = buildResampleTaps(srcHeight, height, filter, ResampleEdge::Clamp, 0);
+        Bitmap level(width, height, bitmap.getDepth(), format);
+        for (int z = 0; z < bitmap.getDepth(); z++) {
+            images[z] = resampleImage(images[z], width, height, tapsX, tapsY);
+            if (content == MipContent::Linear) {
+                storeResampleImage(images[z], level, z);
+                continue;
+            }
+            ResampleImage encoded = images[z];
+            if (content == MipContent::SRGB) {
+                convertResampleImageColors(encoded, convertLinearToSRGB);
+            }
+            else {
+                normalizeResampleImage(encoded);
+            }
+            storeResampleImage(encoded, level, z);
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+std::vector<std::vector<Bitmap>> Bitmap::loadMips(const std::vector<std::pair<std::string, MipContent>>& images, ResampleFilter filter, BitmapFormat format)
+{
+    std::vector<std::string_view> fileNames;
+    for (const auto& image : images) {
+        fileNames.push_back(image.first);
+    }
+    std::vector<std::vector<Bitmap>> mips(images.size());
+    parallelForFiles(fileNames, [&](int i) {
+        const auto& [fileName, content] = images[i];
+        mips[i] = generateMips(Bitmap(fileName, getUncompressedFormat(format)), filter, format, content);
+    });
+    return mips;
+}
+
+std::vector<Bitmap> Bitmap::generateCubeMapMips(const Bitmap& faces, ResampleFilter filter, BitmapFormat format)
+{
+    assert(faces.getDepth() == 6 && faces.getWidth() == faces.getHeight());
+    std::vector<Bitmap> levels;
+    levels.push_back(convertFormat(faces, format));
+    while (levels.back().getWidth() > 1) {
+        const Bitmap& src = levels.back();
+        const int faceSize = src.getWidth() / 2;
+        // Far enough beyond the edges for every tap; each face is padded and filtered on its own, so only one
+        // float copy of a face is held at a time (read back from the previous level, which is exact for RGB32F)
+        const int padding = static_cast<int>(std::ceil(getFilterRadius(filter) * float(src.getWidth()) / float(faceSize))) + 1;
+        const ResampleTaps taps = buildResampleTaps(src.getWidth(), faceSize, filter, ResampleEdge::Clamp, padding);
+        Bitmap level(faceSize, faceSize, 6, format);
+        for (int face = 0; face < 6; face++) {
+            storeResampleImage(resampleImage(padCubeMapFace(src, face, padding), faceSize, faceSize, taps, taps), level, face);
+        }
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+std::vector<Bitmap> Bitmap::convertCubeMapFacesToPrefilteredMips(const Bitmap& faces, int numLevels, int numSamples, BitmapFormat format)
+{
+    assert(faces.getDepth() == 6 && faces.getWidth() == faces.getHeight() && numLevels >= 1);
+    std::vector<Bitmap> levels;
+    levels.push_back(convertFormat(faces, format));
+    if (numLevels == 1) {
+        return levels;
+    }
+
+    // Box-filtered float pyramid of the input, so wide lobes read few texels from a matching level
+    const std::vector<Bitmap> pyramid = generateCubeMapMips(faces, ResampleFilter::Box, BitmapFormat::RGB32F);
+
+    std::vector<std::vector<PrefilterSample>> samples(numLevels);
+    for (int level = 1; level < numLevels; level++) {
+        levels.emplace_back(std::max(faces.getWidth() >> level, 1), std::max(faces.getHeight() >> level, 1), 6, format);
+        // Same mapping as the LOD selection in mesh.frag
+        const float roughness = float(level) / float(numLevels - 1);
+        samples[level] = buildPrefilterSamples(roughness, numSamples, faces.getWidth(), static_cast<int>(pyramid.size()));
+    }
+
+    // One work item per row of every face of every level; large levels come first so the small ones fill the gaps
+    std::vector<glm::ivec3> rows;
+    for (int level = 1; level < numLevels; level++) {
+        for (int face = 0; face < 6; face++) {
+            for (int y = 0; y < levels[level].getHeight(); y++) {
+                rows.emplace_back(level, face, y);
+            }
+        }
+    }
+    const size_t bytesPerPixel = getBytesPerPixel(format);
+    visitFormat(format, [&](auto dstFormat) {
+        parallelFor(0, static_cast<int>(rows.size()), [&](int i) {
+            const int level = rows[i].x;
+            const int face = rows[i].y;
+            const int y = rows[i].z;
+            const int faceSize = levels[level].getWidth();
+            const std::span<uint8_t> row = levels[level].getRow(y, face);
+            for (int x = 0; x < faceSize; x++) {
+                // Split-sum approximation: N = V = R
+                const glm::vec3 n = getCubeMapTexelDirection(face, x, y, faceSize);
+                const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                const glm::vec3 tangentX = glm::normalize(glm::cross(up, n));
+                const glm::vec3 tangentY = glm::cross(n, tangentX);
+                glm::vec3 color = glm::vec3(0.0f);
+                float weight = 0.0f;
+                for (const PrefilterSample& sample : samples[level]) {
+                    const glm::vec3 l = tangentX * sample.direction.x + tangentY * sample.direction.y + n * sample.direction.z;
+                    // Trilinear lookup between the two pyramid levels around the sample's footprint
+                    const int lod0 = static_cast<int>(sample.lod);
+                    const int lod1 = std::min(lod0 + 1, static_cast<int>(pyramid.size()) - 1);
+                    const float t = sample.lod - float(lod0);
+                    const glm::vec3 radiance = glm::mix(sampleCubeMap(pyramid[lod0], l), sampleCubeMap(pyramid[lod1], l), t);
+                    color += radiance * sample.weight;
+                    weight += sample.weight;
+                }
+                storePixel<decltype(dstFormat)::value>(&row[x * bytesPerPixel], weight > 0.0f ? color / weight : color);
+            }
+        });
+    });
+    return levels;
+}
+
+Bitmap Bitmap::convertDiffuseToIrradiance(const Bitmap& input, int srcW, int srcH, int dstW, int dstH, int numMonteCarloSamples, IrradianceSampler sampler)
 {
     assert(srcW == 2 * srcH);
+    if (input.getFormat() != BitmapFormat::RGB32F) {
+        return convertDiffuseToIrradiance(convertFormat(input, BitmapFormat::RGB32F), srcW, srcH, dstW, dstH, numMonteCarloSamples, sampler);
+    }
     Bitmap result(dstW, dstH, 1);
-    std::vector<glm::vec3> tmp(dstW * dstH);
-    stbir_resize(
-        input.getData(), srcW, srcH, 0,
-        reinterpret_cast<float*>(tmp.data()), dstW, dstH, 0,
-        static_cast<stbir_pixel_layout>(3), STBIR_TYPE_FLOAT, STBIR_EDGE_CLAMP, STBIR_FILTER_CUBICBSPLINE);
-    const glm::vec3* scratch = tmp.data();
-    srcW = dstW;
-    srcH = dstH;
-    for (int y = 0; y < dstH; y++) {
+    // Longitude wraps around, latitude ends at the poles
+    const Bitmap resized = resample(input, dstW, dstH, ResampleFilter::Box, ResampleEdge::Wrap, ResampleEdge::Clamp);
+    const glm::vec3* tmp = reinterpret_cast<const glm::vec3*>(resized.getData());
+    if (sampler == IrradianceSampler::CosineWeighted) {
+        // Hemisphere directions relative to the normal, shared by all output texels
+        std::vector<glm::vec3> directions(numMonteCarloSamples);
+        for (int i = 0; i < numMonteCarloSamples; i++) {
+            const glm::vec2 h = hammersley2d(i, numMonteCarloSamples);
+            const float r = std::sqrt(h.y);
+            const float phi = glm::two_pi<float>() * h.x;
+            directions[i] = glm::vec3(r * std::cos(phi), r * std::sin(phi), std::sqrt(1.0f - h.y));
+        }
+        parallelFor(0, dstH, [&](int y) {
+            const float theta1 = float(y) / float(dstH) * glm::pi<float>();
+            const std::span<glm::vec3> row = result.getPixels<glm::vec3>(y);
+            for (int x = 0; x < dstW; x++) {
+                const float phi1 = float(x) / float(dstW) * glm::two_pi<float>();
+                const glm::vec3 v1 = glm::vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
+                row[x] = integrateIrradianceCosineWeighted(directions, tmp, dstW, dstH, v1);
+            }
+        });
+        return result;
+    }
+
+    // The sample directions only depend on the sample index, so they are evaluated once up front
+    const IrradianceSamples samples = buildIrradianceSamples(tmp, dstW, dstH, numMonteCarloSamples);
+    // Rows are independent and each is accumulated in the same order on any thread,
+    // so the result is bit-identical regardless of the thread count.
+    parallelFor(0, dstH, [&](int y) {
         const float theta1 = float(y) / float(dstH) * glm::pi<float>();
+        const std::span<glm::vec3> row = result.getPixels<glm::vec3>(y);
         for (int x = 0; x < dstW; x++) {
             const float phi1 = float(x) / float(dstW) * glm::two_pi<float>();
             const glm::vec3 v1 = glm::vec3(sin(theta1) * cos(phi1), sin(theta1) * sin(phi1), cos(theta1));
-            glm::vec3 color = glm::vec3(0.0f);
-            float weight = 0.0f;
-            for (int i = 0; i < numMonteCarloSamples; i++) {
-                const glm::vec2 h = hammersley2d(i, numMonteCarloSamples);
-                const int x1 = int(floor(h.x * srcW));
-                const int y1 = int(floor(h.y * srcH));
-                const float theta2 = float(y1) / float(srcH) * glm::pi<float>();
-                const float phi2 = float(x1) / float(srcW) * glm::two_pi<float>();
-                const glm::vec3 v2 = glm::vec3(sin(theta2) * cos(phi2), sin(theta2) * sin(phi2), cos(theta2));
-                const float nDotL = std::fmax(0.0f, glm::dot(v1, v2));
-                if (nDotL > 0.01f) {
-                    color += scratch[y1 * srcW + x1] * nDotL;
-                    weight += nDotL;
-                }
+            row[x] = integrateIrradiance(samples, v1);
+        }
+    });
+    return result;
+}
+
+std::array<glm::vec3, 9> Bitmap::convertDiffuseToIrradianceSH(const Bitmap& input)
+{
+    // Per-row partial sums, reduced in row order afterwards so the result does not depend on threading
+    std::vector<std::array<glm::dvec3, 9>> rowSums(input.getHeight());
+    parallelFor(0, input.getHeight(), [&](int y) {
+        rowSums[y] = projectRowOntoSH(input.getRow(y), input.getFormat(), input.getWidth(), y, input.getHeight());
+    });
+    return reduceIrradianceSH(rowSums);
+}
+
+std::array<glm::vec3, 9> Bitmap::convertDiffuseToIrradianceSH(std::string_view fileName)
+{
+    if (!HdrFile::hasSignature(MappedFile(fileName))) {
+        return convertDiffuseToIrradianceSH(Bitmap(fileName));
+    }
+    // Same row sums as above, so both overloads return bit-identical coefficients
+    std::vector<std::array<glm::dvec3, 9>> rowSums;
+    loadBands(fileName, 64, BitmapFormat::RGB32F, [&](const Bitmap& band, int y, int height) {
+        rowSums.resize(height);
+        parallelFor(0, band.getHeight(), [&](int row) {
+            rowSums[y + row] = projectRowOntoSH(band.getRow(row), band.getFormat(), band.getWidth(), y + row, height);
+        });
+    });
+    return reduceIrradianceSH(rowSums);
+}
+
+void Bitmap::loadBands(std::string_view fileName, int bandHeight, BitmapFormat format, const std::function<void(const Bitmap& band, int y, int height)>& consumer)
+{
+    const HdrFile hdr{ MappedFile(fileName) };
+    Bitmap band;
+    for (int y = 0; y < hdr.getHeight(); y += bandHeight) {
+        const int rows = std::min(bandHeight, hdr.getHeight() - y);
+        if (band.getHeight() != rows) {
+            band = Bitmap(hdr.getWidth(), rows, 1, format);
+        }
+        parallelFor(0, rows, [&](int row) {
+            std::vector<uint8_t> scratch;
+            decodeHdrScanline(hdr, y + row, band.getRow(row), format, scratch);
+        });
+        consumer(band, y, hdr.getHeight());
+    }
+}
+
+template<typename Function>
+static void visitFormat(BitmapFormat format, Function&& function)
+{
+    switch (format) {
+    case BitmapFormat::RGB32F:
+        function(std::integral_constant<BitmapFormat, BitmapFormat::RGB32F>());
+        break;
+    case BitmapFormat::RGB16F:
+        function(std::integral_constant<BitmapFormat, BitmapFormat::RGB16F>());
+        break;
+    case BitmapFormat::R11G11B10F:
+        function(std::integral_constant<BitmapFormat, BitmapFormat::R11G11B10F>());
+        break;
+    case BitmapFormat::RGBE8:
+        function(std::integral_constant<BitmapFormat, BitmapFormat::RGBE8>());
+        break;
+    case BitmapFormat::RGBA8:
+        function(std::integral_constant<BitmapFormat, BitmapFormat::RGBA8>());
+        break;
+    default:
+        throw std::invalid_argument("invalid bitmap format");
+    }
+}
+
+template<BitmapFormat Format>
+static glm::vec3 loadPixel(const uint8_t* pixel)
+{
+    if constexpr (Format == BitmapFormat::RGB32F) {
+        glm::vec3 color;
+        std::memcpy(&color, pixel, sizeof(color));
+        return color;
+    }
+    else if constexpr (Format == BitmapFormat::RGB16F) {
+        uint16_t halves[3];
+        std::memcpy(halves, pixel, sizeof(halves));
+        return glm::vec3(glm::unpackHalf1x16(halves[0]), glm::unpackHalf1x16(halves[1]), glm::unpackHalf1x16(halves[2]));
+    }
+    else if constexpr (Format == BitmapFormat::R11G11B10F) {
+        uint32_t packed;
+        std::memcpy(&packed, pixel, sizeof(packed));
+        return glm::unpackF2x11_1x10(packed);
+    }
+    else if constexpr (Format == BitmapFormat::RGBA8) {
+        return glm::vec3(pixel[0], pixel[1], pixel[2]) / 255.0f;
+    }
+    else {
+        // Same decoding as stb_image's Radiance loader
+        if (pixel[3] == 0) {
+            return glm::vec3(0.0f);
+        }
+        const float scale = std::ldexp(1.0f, int(pixel[3]) - (128 + 8));
+        return glm::vec3(pixel[0], pixel[1], pixel[2]) * scale;
+    }
+}
+
+template<BitmapFormat Format>
+static void storePixel(uint8_t* pixel, const glm::vec3& color)
+{
+    if constexpr (Format == BitmapFormat::RGB32F) {
+        std::memcpy(pixel, &color, sizeof(color));
+    }
+    else if constexpr (Format == BitmapFormat::RGB16F) {
+        const uint16_t halves[3] = { glm::packHalf1x16(color.r), glm::packHalf1x16(color.g), glm::packHalf1x16(color.b) };
+        std::memcpy(pixel, halves, sizeof(halves));
+    }
+    else if constexpr (Format == BitmapFormat::R11G11B10F) {
+        // The packed floats are unsigned
+        const uint32_t packed = glm::packF2x11_1x10(glm::max(color, glm::vec3(0.0f)));
+        std::memcpy(pixel, &packed, sizeof(packed));
+    }
+    else if constexpr (Format == BitmapFormat::RGBA8) {
+        const glm::vec3 scaled = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        pixel[0] = static_cast<uint8_t>(scaled.r);
+        pixel[1] = static_cast<uint8_t>(scaled.g);
+        pixel[2] = static_cast<uint8_t>(scaled.b);
+        pixel[3] = 255;
+    }
+    else {
+        const float maxComponent = std::fmax(color.r, std::fmax(color.g, color.b));
+        if (maxComponent < 1e-32f) {
+            std::memset(pixel, 0, 4);
+            return;
+        }
+        int exponent;
+        const float scale = std::frexp(maxComponent, &exponent) * 256.0f / maxComponent;
+        pixel[0] = static_cast<uint8_t>(std::fmax(color.r, 0.0f) * scale);
+        pixel[1] = static_cast<uint8_t>(std::fmax(color.g, 0.0f) * scale);
+        pixel[2] = static_cast<uint8_t>(std::fmax(color.b, 0.0f) * scale);
+        pixel[3] = static_cast<uint8_t>(exponent + 128);
+    }
+}
+
+template<BitmapFormat SrcFormat, BitmapFormat DstFormat>
+static void gatherCubeMapFaces(const CubeMapSamplingTable& table, const uint8_t* src, uint8_t* dst)
+{
+    constexpr size_t srcBytesPerPixel = Bitmap::getBytesPerPixel(SrcFormat);
+    constexpr size_t dstBytesPerPixel = Bitmap::getBytesPerPixel(DstFormat);
+    const int faceSize = table.srcWidth / 4;
+    const size_t srcWidth = table.srcWidth;
+    parallelFor(0, 6 * faceSize, [&](int row) {
+        const size_t begin = static_cast<size_t>(row) * faceSize;
+        for (size_t i = begin; i < begin + faceSize; i++) {
+            const uint32_t tap = table.taps[i];
+            const size_t a = tap & CubeMapSamplingTable::indexMask;
+            const size_t b = (tap & CubeMapSamplingTable::noStepRight) ? a : a + 1;
+            const size_t c = (tap & CubeMapSamplingTable::noStepDown) ? a : a + srcWidth;
+            const size_t d = c + (b - a);
+            const float s = table.weights[i].x;
+            const float t = table.weights[i].y;
+            const glm::vec3 colorA = loadPixel<SrcFormat>(src + a * srcBytesPerPixel);
+            const glm::vec3 colorB = loadPixel<SrcFormat>(src + b * srcBytesPerPixel);
+            const glm::vec3 colorC = loadPixel<SrcFormat>(src + c * srcBytesPerPixel);
+            const glm::vec3 colorD = loadPixel<SrcFormat>(src + d * srcBytesPerPixel);
+            // Biliniear interpolation, evaluated exactly like sampleEquirectangularMap
+            const glm::vec3 color = colorA * (1 - s) * (1 - t) + colorB * s * (1 - t) + colorC * (1 - s) * t + colorD * s * t;
+            storePixel<DstFormat>(dst + i * dstBytesPerPixel, color);
+        }
+    });
+}
+
+static EquirectangularTap getEquirectangularTap(int x, int y, CubemapFace face, int faceSize, int srcWidth, int srcHeight)
+{
+    const int clampWidth = srcWidth - 1;
+    const int clampHeight = srcHeight - 1;
+    const glm::vec3 p = Cubemap::faceCoordsToXYZ(x, y, face, faceSize);
+    const float r = hypot(p.x, p.y);
+    const float theta = atan2(p.y, p.x);
+    const float phi = atan2(p.z, r);
+    constexpr float pi = glm::pi<float>();
+
+    const float uf = float(2.0f * faceSize * (theta + pi) / pi);
+    const float vf = float(2.0f * faceSize * (pi / 2.0f - phi) / pi);
+
+    EquirectangularTap tap;
+    tap.u1 = glm::clamp(int(floor(uf)), 0, clampWidth);
+    tap.v1 = glm::clamp(int(floor(vf)), 0, clampHeight);
+    tap.u2 = glm::clamp(tap.u1 + 1, 0, clampWidth);
+    tap.v2 = glm::clamp(tap.v1 + 1, 0, clampHeight);
+    tap.s = uf - tap.u1;
+    tap.t = vf - tap.v1;
+    return tap;
+}
+
+// Tap of texel (x, y) of a cubemap face in face layout order, see cubeMapFaceSources
+static EquirectangularTap getCubeMapFaceTap(int face, int x, int y, int faceSize, int srcWidth, int srcHeight)
+{
+    const bool rotated = cubeMapFaceSources[face].rotated;
+    const int crossX = rotated ? faceSize - x - 1 : x;
+    const int crossY = rotated ? faceSize - y - 1 : y;
+    return getEquirectangularTap(crossX, crossY, cubeMapFaceSources[face].crossFace, faceSize, srcWidth, srcHeight);
+}
+
+// Bilinearly interpolates a tap from its two source rows v1 and v2
+template<BitmapFormat Format>
+static glm::vec3 sampleEquirectangularRows(const EquirectangularTap& tap, const uint8_t* row1, const uint8_t* row2)
+{
+    constexpr size_t bytesPerPixel = Bitmap::getBytesPerPixel(Format);
+    const float s = tap.s;
+    const float t = tap.t;
+    const glm::vec3 a = loadPixel<Format>(&row1[tap.u1 * bytesPerPixel]);
+    const glm::vec3 b = loadPixel<Format>(&row1[tap.u2 * bytesPerPixel]);
+    const glm::vec3 c = loadPixel<Format>(&row2[tap.u1 * bytesPerPixel]);
+    const glm::vec3 d = loadPixel<Format>(&row2[tap.u2 * bytesPerPixel]);
+
+    // Biliniear interpolation
+    return a * (1 - s) * (1 - t) + b * s * (1 - t) + c * (1 - s) * t + d * s * t;
+}
+
+// Bilinearly samples the equirectangular map for texel (x, y) of the given vertical cross face
+template<BitmapFormat Format>
+static glm::vec3 sampleEquirectangularMap(const Bitmap& bitmap, int x, int y, CubemapFace face, int faceSize)
+{
+    const EquirectangularTap tap = getEquirectangularTap(x, y, face, faceSize, bitmap.getWidth(), bitmap.getHeight());
+    return sampleEquirectangularRows<Format>(tap, bitmap.getRow(tap.v1).data(), bitmap.getRow(tap.v2).data());
+}
+
+// Returns the sampling table for equirects of the given size, building it on first use. The most recently
+// used tables are kept, so reloading or switching between maps of the same resolution skips the trigonometry.
+// Returns nullptr when the table would be too large to be worth keeping around.
+static std::shared_ptr<const CubeMapSamplingTable> getCubeMapSamplingTable(int srcWidth, int srcHeight)
+{
+    constexpr size_t maxTableBytes = 128 << 20;
+    constexpr size_t maxCachedTables = 4;
+    static std::mutex cacheMutex;
+    static std::list<std::shared_ptr<const CubeMapSamplingTable>> cache;
+
+    const int faceSize = srcWidth / 4;
+    const size_t numTexels = 6 * static_cast<size_t>(faceSize) * faceSize;
+    if (numTexels * (sizeof(uint32_t) + sizeof(glm::vec2)) > maxTableBytes
+        || static_cast<size_t>(srcWidth) * srcHeight > CubeMapSamplingTable::indexMask) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        for (auto it = cache.begin(); it != cache.end(); ++it) {
+            if ((*it)->srcWidth == srcWidth && (*it)->srcHeight == srcHeight) {
+                cache.splice(cache.begin(), cache, it);
+                return cache.front();
             }
-            result.setPixel(x, y, 0, color / weight);
         }
     }
-    return result;
+
+    auto table = std::make_shared<CubeMapSamplingTable>();
+    table->srcWidth = srcWidth;
+    table->srcHeight = srcHeight;
+    table->taps.resize(numTexels);
+    table->weights.resize(numTexels);
+    parallelFor(0, 6 * faceSize, [&](int row) {
+        const int face = row / faceSize;
+        const int y = row % faceSize;
+        const CubemapFace crossFace = cubeMapFaceSources[face].crossFace;
+        const bool rotated = cubeMapFaceSources[face].rotated;
+        for (int x = 0; x < faceSize; x++) {
+            const int crossX = rotated ? faceSize - x - 1 : x;
+            const int crossY = rotated ? faceSize - y - 1 : y;
+            const EquirectangularTap tap = getEquirectangularTap(crossX, crossY, crossFace, faceSize, srcWidth, srcHeight);
+            uint32_t packed = static_cast<uint32_t>(tap.v1 * srcWidth + tap.u1);
+            if (tap.u2 == tap.u1) {
+                packed |= CubeMapSamplingTable::noStepRight;
+            }
+            if (tap.v2 == tap.v1) {
+                packed |= CubeMapSamplingTable::noStepDown;
+            }
+            const size_t i = static_cast<size_t>(row) * faceSize + x;
+            table->taps[i] = packed;
+            table->weights[i] = glm::vec2(tap.s, tap.t);
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache.push_front(table);
+    if (cache.size() > maxCachedTables) {
+        cache.pop_back();
+    }
+    return table;
 }
 
 static float radicalInverseVdC(uint32_t bits)
@@ -211,3 +1041,740 @@ static glm::vec2 hammersley2d(uint32_t i, uint32_t N)
 {
     return glm::vec2(float(i) / float(N), radicalInverseVdC(i));
 }
+
+static IrradianceSamples buildIrradianceSamples(const glm::vec3* scratch, int srcW, int srcH, int numMonteCarloSamples)
+{
+    IrradianceSamples samples;
+    samples.count = (numMonteCarloSamples + 7) / 8 * 8;
+    samples.dirX.assign(samples.count, 0.0f);
+    samples.dirY.assign(samples.count, 0.0f);
+    samples.dirZ.assign(samples.count, 0.0f);
+    samples.red.assign(samples.count, 0.0f);
+    samples.green.assign(samples.count, 0.0f);
+    samples.blue.assign(samples.count, 0.0f);
+    for (int i = 0; i < numMonteCarloSamples; i++) {
+        const glm::vec2 h = hammersley2d(i, numMonteCarloSamples);
+        const int x1 = int(floor(h.x * srcW));
+        const int y1 = int(floor(h.y * srcH));
+        const float theta2 = float(y1) / float(srcH) * glm::pi<float>();
+        const float phi2 = float(x1) / float(srcW) * glm::two_pi<float>();
+        samples.dirX[i] = sin(theta2) * cos(phi2);
+        samples.dirY[i] = sin(theta2) * sin(phi2);
+        samples.dirZ[i] = cos(theta2);
+        const glm::vec3& color = scratch[static_cast<size_t>(y1) * srcW + x1];
+        samples.red[i] = color.r;
+        samples.green[i] = color.g;
+        samples.blue[i] = color.b;
+    }
+    return samples;
+}
+
+// Returns the nDotL-weighted average radiance around n, 8 samples at a time. Per-sample weights
+// are computed exactly like the former scalar loop, only the summation order differs. All terms
+// are non-negative, so the 8-lane sums are within (count/8 + 3) * 2^-24 relative error of the exact
+// sum and a sequential sum within count * 2^-24; for 1024 samples both paths therefore agree to
+// better than 1.4e-4 relative error per channel (worst case).
+static glm::vec3 integrateIrradiance(const IrradianceSamples& samples, const glm::vec3& n)
+{
+    float lanes[4][8];
+#if defined(__AVX2__)
+    const __m256 nx = _mm256_set1_ps(n.x);
+    const __m256 ny = _mm256_set1_ps(n.y);
+    const __m256 nz = _mm256_set1_ps(n.z);
+    const __m256 threshold = _mm256_set1_ps(0.01f);
+    __m256 sumR = _mm256_setzero_ps();
+    __m256 sumG = _mm256_setzero_ps();
+    __m256 sumB = _mm256_setzero_ps();
+    __m256 sumW = _mm256_setzero_ps();
+    for (int i = 0; i < samples.count; i += 8) {
+        const __m256 dot = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(&samples.dirX[i])), _mm256_mul_ps(ny, _mm256_loadu_ps(&samples.dirY[i]))),
+            _mm256_mul_ps(nz, _mm256_loadu_ps(&samples.dirZ[i])));
+        const __m256 nDotL = _mm256_and_ps(dot, _mm256_cmp_ps(dot, threshold, _CMP_GT_OQ));
+        sumR = _mm256_add_ps(sumR, _mm256_mul_ps(_mm256_loadu_ps(&samples.red[i]), nDotL));
+        sumG = _mm256_add_ps(sumG, _mm256_mul_ps(_mm256_loadu_ps(&samples.green[i]), nDotL));
+        sumB = _mm256_add_ps(sumB, _mm256_mul_ps(_mm256_loadu_ps(&samples.blue[i]), nDotL));
+        sumW = _mm256_add_ps(sumW, nDotL);
+    }
+    _mm256_storeu_ps(lanes[0], sumR);
+    _mm256_storeu_ps(lanes[1], sumG);
+    _mm256_storeu_ps(lanes[2], sumB);
+    _mm256_storeu_ps(lanes[3], sumW);
+#elif defined(__SSE2__) || defined(_M_X64)
+    // Two 4-wide halves per iteration keep the same 8-lane accumulation order as the AVX2 path
+    const __m128 nx = _mm_set1_ps(n.x);
+    const __m128 ny = _mm_set1_ps(n.y);
+    const __m128 nz = _mm_set1_ps(n.z);
+    const __m128 threshold = _mm_set1_ps(0.01f);
+    __m128 sums[4][2] = {};
+    for (int i = 0; i < samples.count; i += 8) {
+        for (int half = 0; half < 2; half++) {
+            const int j = i + half * 4;
+            const __m128 dot = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(&samples.dirX[j])), _mm_mul_ps(ny, _mm_loadu_ps(&samples.dirY[j]))),
+                _mm_mul_ps(nz, _mm_loadu_ps(&samples.dirZ[j])));
+            const __m128 nDotL = _mm_and_ps(dot, _mm_cmpgt_ps(dot, threshold));
+            sums[0][half] = _mm_add_ps(sums[0][half], _mm_mul_ps(_mm_loadu_ps(&samples.red[j]), nDotL));
+            sums[1][half] = _mm_add_ps(sums[1][half], _mm_mul_ps(_mm_loadu_ps(&samples.green[j]), nDotL));
+            sums[2][half] = _mm_add_ps(sums[2][half], _mm_mul_ps(_mm_loadu_ps(&samples.blue[j]), nDotL));
+            sums[3][half] = _mm_add_ps(sums[3][half], nDotL);
+        }
+    }
+    for (int k = 0; k < 4; k++) {
+        _mm_storeu_ps(&lanes[k][0], sums[k][0]);
+        _mm_storeu_ps(&lanes[k][4], sums[k][1]);
+    }
+#else
+    for (int k = 0; k < 4; k++) {
+        for (int lane = 0; lane < 8; lane++) {
+            lanes[k][lane] = 0.0f;
+        }
+    }
+    for (int i = 0; i < samples.count; i += 8) {
+        for (int lane = 0; lane < 8; lane++) {
+            const int j = i + lane;
+            const float dot = (n.x * samples.dirX[j] + n.y * samples.dirY[j]) + n.z * samples.dirZ[j];
+            const float nDotL = dot > 0.01f ? dot : 0.0f;
+            lanes[0][lane] += samples.red[j] * nDotL;
+            lanes[1][lane] += samples.green[j] * nDotL;
+            lanes[2][lane] += samples.blue[j] * nDotL;
+            lanes[3][lane] += nDotL;
+        }
+    }
+#endif
+    float totals[4];
+    for (int k = 0; k < 4; k++) {
+        totals[k] = ((lanes[k][0] + lanes[k][4]) + (lanes[k][1] + lanes[k][5])) + ((lanes[k][2] + lanes[k][6]) + (lanes[k][3] + lanes[k][7]));
+    }
+    return glm::vec3(totals[0], totals[1], totals[2]) / totals[3];
+}
+
+// With directions drawn proportional to cos(theta), the normalized irradiance is the plain mean of the
+// radiance they hit. Lookups are bilinear; texel (x, y) lies in the direction buildIrradianceSamples
+// assigns to it, with x wrapping around and y clamped at the poles.
+static glm::vec3 integrateIrradianceCosineWeighted(const std::vector<glm::vec3>& directions, const glm::vec3* src, int srcW, int srcH, const glm::vec3& n)
+{
+    const glm::vec3 up = std::abs(n.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 tangentX = glm::normalize(glm::cross(up, n));
+    const glm::vec3 tangentY = glm::cross(n, tangentX);
+    glm::vec3 sum = glm::vec3(0.0f);
+    for (const glm::vec3& direction : directions) {
+        const glm::vec3 l = tangentX * direction.x + tangentY * direction.y + n * direction.z;
+        float phi = std::atan2(l.y, l.x);
+        if (phi < 0.0f) {
+            phi += glm::two_pi<float>();
+        }
+        const float theta = std::acos(glm::clamp(l.z, -1.0f, 1.0f));
+        const float fx = phi / glm::two_pi<float>() * float(srcW);
+        const float fy = glm::min(theta / glm::pi<float>() * float(srcH), float(srcH - 1));
+        const int x1 = static_cast<int>(fx) % srcW;
+        const int y1 = static_cast<int>(fy);
+        const int x2 = (x1 + 1) % srcW;
+        const int y2 = std::min(y1 + 1, srcH - 1);
+        const float s = fx - std::floor(fx);
+        const float t = fy - float(y1);
+        const glm::vec3* row1 = src + static_cast<size_t>(y1) * srcW;
+        const glm::vec3* row2 = src + static_cast<size_t>(y2) * srcW;
+        sum += glm::mix(glm::mix(row1[x1], row1[x2], s), glm::mix(row2[x1], row2[x2], s), t);
+    }
+    return sum / float(directions.size());
+}
+
+// Direction through the center of a texel of a GL cubemap face (faces in +X, -X, +Y, -Y, +Z, -Z order)
+static glm::vec3 getCubeMapTexelDirection(int face, int x, int y, int faceSize)
+{
+    const float u = (float(x) + 0.5f) / float(faceSize) * 2.0f - 1.0f;
+    const float v = (float(y) + 0.5f) / float(faceSize) * 2.0f - 1.0f;
+    glm::vec3 direction;
+    switch (static_cast<CubemapFace>(face)) {
+    case CubemapFace::PositiveX:
+        direction = glm::vec3(1.0f, -v, -u);
+        break;
+    case CubemapFace::NegativeX:
+        direction = glm::vec3(-1.0f, -v, u);
+        break;
+    case CubemapFace::PositiveY:
+        direction = glm::vec3(u, 1.0f, v);
+        break;
+    case CubemapFace::NegativeY:
+        direction = glm::vec3(u, -1.0f, -v);
+        break;
+    case CubemapFace::PositiveZ:
+        direction = glm::vec3(u, -v, 1.0f);
+        break;
+    case CubemapFace::NegativeZ:
+        direction = glm::vec3(-u, -v, -1.0f);
+        break;
+    }
+    return glm::normalize(direction);
+}
+
+// Face that direction points into with the GL face selection rules, and the position on it in [-1, 1];
+// the inverse of getCubeMapTexelDirection
+static int getCubeMapFaceCoords(const glm::vec3& direction, glm::vec2& uv)
+{
+    const glm::vec3 a = glm::abs(direction);
+    if (a.x >= a.y && a.x >= a.z) {
+        uv = glm::vec2(direction.x > 0.0f ? -direction.z : direction.z, -direction.y) / a.x;
+        return direction.x > 0.0f ? 0 : 1;
+    }
+    if (a.y >= a.z) {
+        uv = glm::vec2(direction.x, direction.y > 0.0f ? direction.z : -direction.z) / a.y;
+        return direction.y > 0.0f ? 2 : 3;
+    }
+    uv = glm::vec2(direction.z > 0.0f ? direction.x : -direction.x, -direction.y) / a.z;
+    return direction.z > 0.0f ? 4 : 5;
+}
+
+// Bilinear lookup in RGB32F cubemap faces with the GL face selection rules; filtering is clamped at face edges
+static glm::vec3 sampleCubeMap(const Bitmap& faces, const glm::vec3& direction)
+{
+    glm::vec2 uv;
+    const int face = getCubeMapFaceCoords(direction, uv);
+    const int faceSize = faces.getWidth();
+    const float fx = glm::clamp((uv.x * 0.5f + 0.5f) * float(faceSize) - 0.5f, 0.0f, float(faceSize - 1));
+    const float fy = glm::clamp((uv.y * 0.5f + 0.5f) * float(faceSize) - 0.5f, 0.0f, float(faceSize - 1));
+    const int x1 = static_cast<int>(fx);
+    const int y1 = static_cast<int>(fy);
+    const int x2 = std::min(x1 + 1, faceSize - 1);
+    const int y2 = std::min(y1 + 1, faceSize - 1);
+    const float s = fx - float(x1);
+    const float t = fy - float(y1);
+    const std::span<const glm::vec3> row1 = faces.getPixels<glm::vec3>(y1, face);
+    const std::span<const glm::vec3> row2 = faces.getPixels<glm::vec3>(y2, face);
+    return glm::mix(glm::mix(row1[x1], row1[x2], s), glm::mix(row2[x1], row2[x2], s), t);
+}
+
+// GGX importance samples for a given perceptual roughness. The source level of each sample follows
+// "GPU-Based Importance Sampling" (GPU Gems 3, ch. 20): the solid angle a sample covers, 1 / (N * pdf),
+// against the solid angle of a texel of the full resolution faces.
+static std::vector<PrefilterSample> buildPrefilterSamples(float roughness, int numSamples, int srcFaceSize, int numSrcLevels)
+{
+    const float alpha = roughness * roughness;
+    const float alpha2 = alpha * alpha;
+    const float texelSolidAngle = 4.0f * glm::pi<float>() / (6.0f * float(srcFaceSize) * float(srcFaceSize));
+    std::vector<PrefilterSample> samples;
+    samples.reserve(numSamples);
+    for (int i = 0; i < numSamples; i++) {
+        const glm::vec2 xi = hammersley2d(i, numSamples);
+        const float phi = glm::two_pi<float>() * xi.x;
+        const float cosTheta = std::sqrt((1.0f - xi.y) / (1.0f + (alpha2 - 1.0f) * xi.y));
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        const glm::vec3 h = glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+        // Reflect (0, 0, 1) about h
+        const glm::vec3 l = 2.0f * cosTheta * h - glm::vec3(0.0f, 0.0f, 1.0f);
+        if (l.z <= 0.0f) {
+            continue;
+        }
+        // With N = V the pdf of l is D(h) / 4
+        const float d = (alpha2 - 1.0f) * cosTheta * cosTheta + 1.0f;
+        const float pdf = alpha2 / (glm::pi<float>() * d * d) / 4.0f;
+        const float sampleSolidAngle = 1.0f / (float(numSamples) * pdf);
+        const float lod = glm::clamp(0.5f * std::log2(sampleSolidAngle / texelSolidAngle), 0.0f, float(numSrcLevels - 1));
+        samples.push_back({ l, l.z, lod });
+    }
+    return samples;
+}
+
+// Decodes a Radiance scanline into a row of the given format; scratch holds the RGBE pixels for other formats
+static void decodeHdrScanline(const HdrFile& hdr, int y, std::span<uint8_t> row, BitmapFormat format, std::vector<uint8_t>& scratch)
+{
+    if (format == BitmapFormat::RGBE8) {
+        hdr.decodeScanline(y, row);
+        return;
+    }
+    scratch.resize(static_cast<size_t>(hdr.getWidth()) * 4);
+    hdr.decodeScanline(y, scratch);
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(format);
+    visitFormat(format, [&](auto dstFormat) {
+        for (int x = 0; x < hdr.getWidth(); x++) {
+            // Decodes exactly like stb_image did before, so RGB32F results are unchanged
+            const glm::vec3 color = loadPixel<BitmapFormat::RGBE8>(&scratch[x * 4]);
+            storePixel<decltype(dstFormat)::value>(&row[x * bytesPerPixel], color);
+        }
+    });
+}
+
+// Averages the factor x factor blocks of src (an RGB32F band starting at image row srcY, a multiple of factor)
+// into the rows of dst they cover. Blocks cut off by the right or bottom edge average the pixels they contain.
+// Whether the pixels of a width x height map, decoded to RGB32F, take more than memoryBudget bytes
+static bool exceedsDecodedByteSize(int width, int height, size_t memoryBudget)
+{
+    return static_cast<size_t>(width) * height * Bitmap::getBytesPerPixel(BitmapFormat::RGB32F) > memoryBudget;
+}
+
+// Smallest power of two that reduces width to at most maxWidth
+static int getDownsampleFactor(int width, int maxWidth)
+{
+    int factor = 1;
+    while (width > maxWidth * factor) {
+        factor *= 2;
+    }
+    return factor;
+}
+
+static void downsampleRows(const Bitmap& src, int srcY, int factor, Bitmap& dst)
+{
+    assert(src.getFormat() == BitmapFormat::RGB32F && srcY % factor == 0);
+    const int dstY = srcY / factor;
+    const int numRows = (src.getHeight() + factor - 1) / factor;
+    parallelFor(0, numRows, [&](int row) {
+        const int y0 = row * factor;
+        const int y1 = std::min(y0 + factor, src.getHeight());
+        const std::span<glm::vec3> dstRow = dst.getPixels<glm::vec3>(dstY + row);
+        for (int x = 0; x < dst.getWidth(); x++) {
+            const int x0 = x * factor;
+            const int x1 = std::min(x0 + factor, src.getWidth());
+            glm::vec3 sum(0.0f);
+            for (int y = y0; y < y1; y++) {
+                const std::span<const glm::vec3> srcRow = src.getPixels<glm::vec3>(y);
+                for (int i = x0; i < x1; i++) {
+                    sum += srcRow[i];
+                }
+            }
+            dstRow[x] = sum / float((y1 - y0) * (x1 - x0));
+        }
+    });
+}
+
+// Solid angle weighted projection of one equirect row onto the 9 SH basis functions
+static std::array<glm::dvec3, 9> projectRowOntoSH(std::span<const uint8_t> row, BitmapFormat format, int width, int y, int height)
+{
+    // Same parametrization as convertEquirectangularMapToVerticalCross, sampled at texel centers
+    const double phi = glm::half_pi<double>() - (double(y) + 0.5) / double(height) * glm::pi<double>();
+    const double solidAngle = (glm::two_pi<double>() / width) * (glm::pi<double>() / height) * cos(phi);
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(format);
+    std::array<glm::dvec3, 9> sums;
+    sums.fill(glm::dvec3(0.0));
+    visitFormat(format, [&](auto srcFormat) {
+        for (int x = 0; x < width; x++) {
+            const double theta = (double(x) + 0.5) / double(width) * glm::two_pi<double>() - glm::pi<double>();
+            const glm::dvec3 p = glm::dvec3(cos(phi) * cos(theta), cos(phi) * sin(theta), sin(phi));
+            // Cross space (see Cubemap::faceCoordsToXYZ) to the direction the shader samples the cubemap with
+            const glm::dvec3 d = glm::dvec3(-p.y, p.z, -p.x);
+            const glm::dvec3 radiance = glm::dvec3(loadPixel<decltype(srcFormat)::value>(&row[x * bytesPerPixel])) * solidAngle;
+            sums[0] += radiance * 0.282095;
+            sums[1] += radiance * (0.488603 * d.y);
+            sums[2] += radiance * (0.488603 * d.z);
+            sums[3] += radiance * (0.488603 * d.x);
+            sums[4] += radiance * (1.092548 * d.x * d.y);
+            sums[5] += radiance * (1.092548 * d.y * d.z);
+            sums[6] += radiance * (0.315392 * (3.0 * d.z * d.z - 1.0));
+            sums[7] += radiance * (1.092548 * d.x * d.z);
+            sums[8] += radiance * (0.546274 * (d.x * d.x - d.y * d.y));
+        }
+    });
+    return sums;
+}
+
+static std::array<glm::vec3, 9> reduceIrradianceSH(const std::vector<std::array<glm::dvec3, 9>>& rowSums)
+{
+    // Cosine lobe convolution per band (pi, 2pi/3, pi/4), divided by pi
+    constexpr double bandFactors[9] = { 1.0, 2.0 / 3.0, 2.0 / 3.0, 2.0 / 3.0, 0.25, 0.25, 0.25, 0.25, 0.25 };
+    std::array<glm::vec3, 9> coefficients;
+    for (int i = 0; i < 9; i++) {
+        glm::dvec3 sum = glm::dvec3(0.0);
+        for (const std::array<glm::dvec3, 9>& sums : rowSums) {
+            sum += sums[i];
+        }
+        coefficients[i] = glm::vec3(sum * bandFactors[i]);
+    }
+    return coefficients;
+}
+
+// Encodes one block of 4x4 RGBA8 texels in row-major order into BC7, BC5 or BC4
+static void encodeUnormBlock(BitmapFormat format, std::span<const uint8_t, 64> texels, uint8_t* block)
+{
+    if (format == BitmapFormat::BC7) {
+        encodeBlockBC7(texels, std::span<uint8_t, blockCompressedBlockSize>(block, blockCompressedBlockSize));
+        return;
+    }
+    const int numChannels = format == BitmapFormat::BC5 ? 2 : 1;
+    for (int c = 0; c < numChannels; c++) {
+        std::array<uint8_t, 16> values;
+        for (int i = 0; i < 16; i++) {
+            values[i] = texels[i * 4 + c];
+        }
+        encodeBlockBC4(values, std::span<uint8_t, blockCompressedBC4BlockSize>(block + c * blockCompressedBC4BlockSize, blockCompressedBC4BlockSize));
+    }
+}
+
+static void decodeUnormBlock(BitmapFormat format, const uint8_t* block, std::span<uint8_t, 64> texels)
+{
+    if (format == BitmapFormat::BC7) {
+        decodeBlockBC7(std::span<const uint8_t, blockCompressedBlockSize>(block, blockCompressedBlockSize), texels);
+        return;
+    }
+    for (int i = 0; i < 16; i++) {
+        texels[i * 4] = 0;
+        texels[i * 4 + 1] = 0;
+        texels[i * 4 + 2] = 0;
+        texels[i * 4 + 3] = 255;
+    }
+    const int numChannels = format == BitmapFormat::BC5 ? 2 : 1;
+    for (int c = 0; c < numChannels; c++) {
+        std::array<uint8_t, 16> values;
+        decodeBlockBC4(std::span<const uint8_t, blockCompressedBC4BlockSize>(block + c * blockCompressedBC4BlockSize, blockCompressedBC4BlockSize), values);
+        for (int i = 0; i < 16; i++) {
+            texels[i * 4 + c] = values[i];
+        }
+    }
+}
+
+// Encodes an uncompressed bitmap into a block-compressed one of the same size, one work item per row of blocks.
+// Blocks that extend beyond the right or bottom edge repeat the last column or row.
+static void encodeBlocks(const Bitmap& src, Bitmap& dst)
+{
+    if (Bitmap::isBlockCompressed(src.getFormat())) {
+        throw std::invalid_argument("cannot convert between block-compressed formats");
+    }
+    const BitmapFormat format = dst.getFormat();
+    if (format != BitmapFormat::BC6H && src.getFormat() != BitmapFormat::RGBA8) {
+        encodeBlocks(Bitmap::convertFormat(src, BitmapFormat::RGBA8), dst);
+        return;
+    }
+    const int width = src.getWidth();
+    const int height = src.getHeight();
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const size_t layerSize = Bitmap::getLayerByteSize(format, width, height);
+    const size_t blockByteSize = Bitmap::getBlockByteSize(format);
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(src.getFormat());
+    if (format != BitmapFormat::BC6H) {
+        parallelFor(0, blocksY * src.getDepth(), [&](int blockRow) {
+            const int z = blockRow / blocksY;
+            const int blockY = blockRow % blocksY;
+            uint8_t* blocks = dst.getData() + z * layerSize + static_cast<size_t>(blockY) * blocksX * blockByteSize;
+            for (int blockX = 0; blockX < blocksX; blockX++) {
+                std::array<uint8_t, 64> texels;
+                for (int i = 0; i < 16; i++) {
+                    const int x = std::min(blockX * 4 + i % 4, width - 1);
+                    const int y = std::min(blockY * 4 + i / 4, height - 1);
+                    std::memcpy(&texels[i * 4], &src.getRow(y, z)[x * bytesPerPixel], 4);
+                }
+                encodeUnormBlock(format, texels, blocks + blockX * blockByteSize);
+            }
+        });
+        return;
+    }
+    visitFormat(src.getFormat(), [&](auto srcFormat) {
+        parallelFor(0, blocksY * src.getDepth(), [&](int blockRow) {
+            const int z = blockRow / blocksY;
+            const int blockY = blockRow % blocksY;
+            uint8_t* blocks = dst.getData() + z * layerSize + static_cast<size_t>(blockY) * blocksX * blockCompressedBlockSize;
+            for (int blockX = 0; blockX < blocksX; blockX++) {
+                std::array<glm::vec3, 16> texels;
+                for (int i = 0; i < 16; i++) {
+                    const int x = std::min(blockX * 4 + i % 4, width - 1);
+                    const int y = std::min(blockY * 4 + i / 4, height - 1);
+                    texels[i] = loadPixel<decltype(srcFormat)::value>(&src.getRow(y, z)[x * bytesPerPixel]);
+                }
+                encodeBlockBC6H(texels, std::span<uint8_t, blockCompressedBlockSize>(blocks + blockX * blockCompressedBlockSize, blockCompressedBlockSize));
+            }
+        });
+    });
+}
+
+static void decodeBlocks(const Bitmap& src, Bitmap& dst)
+{
+    if (Bitmap::isBlockCompressed(dst.getFormat())) {
+        throw std::invalid_argument("cannot convert between block-compressed formats");
+    }
+    const BitmapFormat format = src.getFormat();
+    if (format != BitmapFormat::BC6H && dst.getFormat() != BitmapFormat::RGBA8) {
+        Bitmap decoded(src.getWidth(), src.getHeight(), src.getDepth(), BitmapFormat::RGBA8);
+        decodeBlocks(src, decoded);
+        dst = Bitmap::convertFormat(decoded, dst.getFormat());
+        return;
+    }
+    const int width = src.getWidth();
+    const int height = src.getHeight();
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const size_t layerSize = Bitmap::getLayerByteSize(format, width, height);
+    const size_t blockByteSize = Bitmap::getBlockByteSize(format);
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(dst.getFormat());
+    if (format != BitmapFormat::BC6H) {
+        parallelFor(0, blocksY * src.getDepth(), [&](int blockRow) {
+            const int z = blockRow / blocksY;
+            const int blockY = blockRow % blocksY;
+            const uint8_t* blocks = src.getData() + z * layerSize + static_cast<size_t>(blockY) * blocksX * blockByteSize;
+            for (int blockX = 0; blockX < blocksX; blockX++) {
+                std::array<uint8_t, 64> texels;
+                decodeUnormBlock(format, blocks + blockX * blockByteSize, texels);
+                for (int i = 0; i < 16; i++) {
+                    const int x = blockX * 4 + i % 4;
+                    const int y = blockY * 4 + i / 4;
+                    if (x < width && y < height) {
+                        std::memcpy(&dst.getRow(y, z)[x * bytesPerPixel], &texels[i * 4], 4);
+                    }
+                }
+            }
+        });
+        return;
+    }
+    visitFormat(dst.getFormat(), [&](auto dstFormat) {
+        parallelFor(0, blocksY * src.getDepth(), [&](int blockRow) {
+            const int z = blockRow / blocksY;
+            const int blockY = blockRow % blocksY;
+            const uint8_t* blocks = src.getData() + z * layerSize + static_cast<size_t>(blockY) * blocksX * blockCompressedBlockSize;
+            for (int blockX = 0; blockX < blocksX; blockX++) {
+                std::array<glm::vec3, 16> texels;
+                decodeBlockBC6H(std::span<const uint8_t, blockCompressedBlockSize>(blocks + blockX * blockCompressedBlockSize, blockCompressedBlockSize), texels);
+                for (int i = 0; i < 16; i++) {
+                    const int x = blockX * 4 + i % 4;
+                    const int y = blockY * 4 + i / 4;
+                    if (x < width && y < height) {
+                        storePixel<decltype(dstFormat)::value>(&dst.getRow(y, z)[x * bytesPerPixel], texels[i]);
+                    }
+                }
+            }
+        });
+    });
+}
+
+static float getFilterRadius(ResampleFilter filter)
+{
+    return filter == ResampleFilter::Box ? 0.5f : kaiserRadius;
+}
+
+// Kaiser-windowed sinc; the Bessel function I0 is evaluated by its power series
+static float evaluateKaiser(float x)
+{
+    auto besselI0 = [](float x) {
+        float sum = 1.0f;
+        float term = 1.0f;
+        for (int k = 1; k < 16; k++) {
+            const float factor = x * 0.5f / float(k);
+            term *= factor * factor;
+            sum += term;
+        }
+        return sum;
+    };
+    if (std::abs(x) >= kaiserRadius) {
+        return 0.0f;
+    }
+    const float t = x / kaiserRadius;
+    const float sinc = x == 0.0f ? 1.0f : std::sin(glm::pi<float>() * x) / (glm::pi<float>() * x);
+    return sinc * besselI0(kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kaiserAlpha);
+}
+
+// Taps that map srcSize texels onto dstSize texels. When minifying, the filter is stretched to the output
+// spacing so it also acts as the low-pass. Clamped taps stay within padding texels beyond the source edges.
+static ResampleTaps buildResampleTaps(int srcSize, int dstSize, ResampleFilter filter, ResampleEdge edge, int padding)
+{
+    const float scale = float(srcSize) / float(dstSize);
+    const float filterScale = std::max(scale, 1.0f);
+    const float radius = getFilterRadius(filter) * filterScale;
+    ResampleTaps taps;
+    taps.offsets.push_back(0);
+    for (int i = 0; i < dstSize; i++) {
+        // Output texel center in source texel units
+        const float center = (float(i) + 0.5f) * scale;
+        const size_t first = taps.weights.size();
+        float sum = 0.0f;
+        for (int j = static_cast<int>(std::floor(center - radius)); j < static_cast<int>(std::ceil(center + radius)); j++) {
+            float weight;
+            if (filter == ResampleFilter::Box) {
+                // Overlap of source texel j with the footprint of the output texel
+                weight = std::min(float(j + 1), center + radius) - std::max(float(j), center - radius);
+                if (weight <= 0.0f) {
+                    continue;
+                }
+            }
+            else {
+                weight = evaluateKaiser((float(j) + 0.5f - center) / filterScale);
+                if (weight == 0.0f) {
+                    continue;
+                }
+            }
+            const int index = edge == ResampleEdge::Wrap ? (j % srcSize + srcSize) % srcSize : std::clamp(j, -padding, srcSize + padding - 1);
+            taps.indices.push_back(index + padding);
+            taps.weights.push_back(weight);
+            sum += weight;
+        }
+        for (size_t k = first; k < taps.weights.size(); k++) {
+            taps.weights[k] /= sum;
+        }
+        taps.offsets.push_back(static_cast<int>(taps.weights.size()));
+    }
+    return taps;
+}
+
+// Converts count pixels of a bitmap row, starting at x, into four float channels each
+static void loadResampleRow(const Bitmap& bitmap, int x, int y, int z, int count, float* dst)
+{
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(bitmap.getFormat());
+    const uint8_t* src = bitmap.getRow(y, z).data() + x * bytesPerPixel;
+    visitFormat(bitmap.getFormat(), [&](auto srcFormat) {
+        for (int i = 0; i < count; i++) {
+            if constexpr (decltype(srcFormat)::value == BitmapFormat::RGBA8) {
+                for (int c = 0; c < 4; c++) {
+                    dst[i * 4 + c] = float(src[i * 4 + c]) / 255.0f;
+                }
+            }
+            else {
+                const glm::vec3 color = loadPixel<decltype(srcFormat)::value>(&src[i * bytesPerPixel]);
+                dst[i * 4 + 0] = color.r;
+                dst[i * 4 + 1] = color.g;
+                dst[i * 4 + 2] = color.b;
+                dst[i * 4 + 3] = 1.0f;
+            }
+        }
+    });
+}
+
+static ResampleImage loadResampleImage(const Bitmap& bitmap, int z)
+{
+    ResampleImage image{ bitmap.getWidth(), bitmap.getHeight(), std::vector<float>(static_cast<size_t>(bitmap.getWidth()) * bitmap.getHeight() * 4) };
+    parallelFor(0, image.height, [&](int y) {
+        loadResampleRow(bitmap, 0, y, z, image.width, image.getRow(y));
+    });
+    return image;
+}
+
+static void storeResampleImage(const ResampleImage& image, Bitmap& bitmap, int z)
+{
+    const size_t bytesPerPixel = Bitmap::getBytesPerPixel(bitmap.getFormat());
+    visitFormat(bitmap.getFormat(), [&](auto dstFormat) {
+        parallelFor(0, image.height, [&](int y) {
+            const float* src = image.getRow(y);
+            const std::span<uint8_t> row = bitmap.getRow(y, z);
+            for (int x = 0; x < image.width; x++) {
+                if constexpr (decltype(dstFormat)::value == BitmapFormat::RGBA8) {
+                    for (int c = 0; c < 4; c++) {
+                        row[x * 4 + c] = static_cast<uint8_t>(std::clamp(src[x * 4 + c], 0.0f, 1.0f) * 255.0f + 0.5f);
+                    }
+                }
+                else {
+                    storePixel<decltype(dstFormat)::value>(&row[x * bytesPerPixel], glm::vec3(src[x * 4], src[x * 4 + 1], src[x * 4 + 2]));
+                }
+            }
+        });
+    });
+}
+
+// Applies convert to the color channels, leaving alpha as is
+static void convertResampleImageColors(ResampleImage& image, float (*convert)(float))
+{
+    parallelFor(0, image.height, [&](int y) {
+        float* row = image.getRow(y);
+        for (int x = 0; x < image.width; x++) {
+            for (int c = 0; c < 3; c++) {
+                row[x * 4 + c] = convert(row[x * 4 + c]);
+            }
+        }
+    });
+}
+
+// Rescales encoded normals to unit length; filtering shortens them where the input normals diverge
+static void normalizeResampleImage(ResampleImage& image)
+{
+    parallelFor(0, image.height, [&](int y) {
+        float* row = image.getRow(y);
+        for (int x = 0; x < image.width; x++) {
+            const glm::vec3 normal = glm::vec3(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]) * 2.0f - 1.0f;
+            const float length = glm::length(normal);
+            const glm::vec3 unitNormal = length > 1e-6f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            row[x * 4 + 0] = unitNormal.x * 0.5f + 0.5f;
+            row[x * 4 + 1] = unitNormal.y * 0.5f + 0.5f;
+            row[x * 4 + 2] = unitNormal.z * 0.5f + 0.5f;
+        }
+    });
+}
+
+static float convertSRGBToLinear(float value)
+{
+    return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static float convertLinearToSRGB(float value)
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+// One cubemap face with padding extra texels on every side. Texels beyond the edges take the nearest texel
+// in the direction they point to, which lies on a neighbouring face, so filters run across the seams.
+static ResampleImage padCubeMapFace(const Bitmap& faces, int face, int padding)
+{
+    const int faceSize = faces.getWidth();
+    const int size = faceSize + 2 * padding;
+    ResampleImage padded{ size, size, std::vector<float>(static_cast<size_t>(size) * size * 4) };
+    parallelFor(0, size, [&](int row) {
+        const int y = row - padding;
+        float* dst = padded.getRow(row);
+        const bool isFaceRow = y >= 0 && y < faceSize;
+        if (isFaceRow) {
+            loadResampleRow(faces, 0, y, face, faceSize, dst + padding * 4);
+        }
+        for (int x = -padding; x < faceSize + padding; x++) {
+            if (isFaceRow && x >= 0 && x < faceSize) {
+                continue;
+            }
+            glm::vec2 uv;
+            const int srcFace = getCubeMapFaceCoords(getCubeMapTexelDirection(face, x, y, faceSize), uv);
+            const int srcX = std::clamp(static_cast<int>((uv.x * 0.5f + 0.5f) * float(faceSize)), 0, faceSize - 1);
+            const int srcY = std::clamp(static_cast<int>((uv.y * 0.5f + 0.5f) * float(faceSize)), 0, faceSize - 1);
+            loadResampleRow(faces, srcX, srcY, srcFace, 1, dst + (x + padding) * 4);
+        }
+    });
+    return padded;
+}
+
+// Separable filter: each output row is the weighted sum of source rows, which is then filtered horizontally.
+// Bands of rows run in parallel; every texel is accumulated in the same order on any thread.
+static ResampleImage resampleImage(const ResampleImage& src, int width, int height, const ResampleTaps& tapsX, const ResampleTaps& tapsY)
+{
+    ResampleImage dst{ width, height, std::vector<float>(static_cast<size_t>(width) * height * 4) };
+    constexpr int bandHeight = 16;
+    parallelFor(0, (height + bandHeight - 1) / bandHeight, [&](int band) {
+        std::vector<float> row(static_cast<size_t>(src.width) * 4);
+        for (int y = band * bandHeight; y < std::min((band + 1) * bandHeight, height); y++) {
+            std::fill(row.begin(), row.end(), 0.0f);
+            for (int k = tapsY.offsets[y]; k < tapsY.offsets[y + 1]; k++) {
+                addWeightedRow(row.data(), src.getRow(tapsY.indices[k]), tapsY.weights[k], row.size());
+            }
+            filterRow(row.data(), tapsX, dst.getRow(y), width);
+        }
+    });
+    return dst;
+}
+
+// dst += src * weight over count floats
+static void addWeightedRow(float* dst, const float* src, float weight, size_t count)
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256 weights = _mm256_set1_ps(weight);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), weights)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += src[i] * weight;
+    }
+}
+
+// Horizontal pass over one row of four-channel pixels; negative lobes of the filter are clamped away
+static void filterRow(const float* src, const ResampleTaps& taps, float* dst, int width)
+{
+    for (int x = 0; x < width; x++) {
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128 sum = _mm_setzero_ps();
+        for (int k = taps.offsets[x]; k < taps.offsets[x + 1]; k++) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + taps.indices[k] * 4), _mm_set1_ps(taps.weights[k])));
+        }
+        _mm_storeu_ps(dst + x * 4, _mm_max_ps(sum, _mm_setzero_ps()));
+#else
+        float sum[4] = {};
+        for (int k = taps.offsets[x]; k < taps.offsets[x + 1]; k++) {
+            for (int c = 0; c < 4; c++) {
+                sum[c] += src[taps.indices[k] * 4 + c] * taps.weights[k];
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            dst[x * 4 + c] = std::max(sum[c], 0.0f);
+        }
+#endif
+    }
+}
@@ -1,14 +1,97 @@
 #pragma once
 
+#include <array>
+#include <functional>
+#include <span>
 #include <string>
 #include <vector>
+#include <cstdint>
+#include <stdexcept>
 #include <glm/glm.hpp>
 
+// Pixel storage formats; RGBA8, BC7, BC5 and BC4 hold material textures, the others RGB radiance
+enum class BitmapFormat {
+    // 3 x 32-bit float
+    RGB32F,
+    // 3 x 16-bit half float
+    RGB16F,
+    // Packed unsigned 11/11/10-bit floats, red in the low bits (GL_UNSIGNED_INT_10F_11F_11F_REV)
+    R11G11B10F,
+    // Radiance shared-exponent encoding, 8-bit mantissas plus a common exponent byte
+    RGBE8,
+    // 4 x 8-bit unsigned normalized, for material textures; alpha reads as 1 through getPixel()
+    RGBA8,
+    // Block-compressed unsigned half floats, 16 bytes per 4x4 pixels. Rows, views and single pixels cannot be
+    // accessed; convertFormat() encodes and decodes it.
+    BC6H,
+    // Block-compressed RGBA8, 16 bytes per 4x4 pixels; converted like BC6H
+    BC7,
+    // Block-compressed red and green of RGBA8, 16 bytes per 4x4 pixels; decodes with blue 0 and alpha 1
+    BC5,
+    // Block-compressed red of RGBA8, 8 bytes per 4x4 pixels; decodes with green and blue 0 and alpha 1
+    BC4
+};
+
+// Sample distributions of the Monte Carlo irradiance convolution
+enum class IrradianceSampler {
+    // Hammersley points spread evenly over the equirect texels and shared by all output texels;
+    // samples below the horizon are discarded and the texel area is not weighted by sin(theta)
+    Uniform,
+    // Hammersley points mapped to a cosine-weighted hemisphere around each output texel's normal,
+    // so every sample contributes and the estimate is an unweighted mean of the radiance it hits
+    CosineWeighted
+};
+
+// Reconstruction filters of Bitmap::resample() and the mip generators
+enum class ResampleFilter {
+    // Area average of the source texels under each output texel; exact 2x2 averages for mips
+    Box,
+    // Kaiser-windowed sinc (radius 3, alpha 4), sharper than Box with little ringing
+    Kaiser
+};
+
+// What the channels of an image generateMips() filters hold
+enum class MipContent {
+    Linear,
+    // Color in the sRGB transfer function, e.g. albedo; filtered in linear space, alpha stays linear
+    SRGB,
+    // Tangent-space normals encoded as n * 0.5 + 0.5; every level is renormalized
+    Normals
+};
+
+// How filter taps beyond the edge of an image are resolved
+enum class ResampleEdge {
+    Clamp,
+    // Periodic, e.g. the longitude of an equirectangular map
+    Wrap
+};
+
+// Rows of a rectangle within one layer of a bitmap. Rows are rowStride bytes apart, so a view can
+// also describe a single face inside a vertical cross. Byte is uint8_t or const uint8_t.
+template<typename Byte>
+struct BasicBitmapView {
+    Byte* data = nullptr;
+    int width = 0;
+    int height = 0;
+    size_t rowStride = 0;
+    BitmapFormat format = BitmapFormat::RGB32F;
+
+    std::span<Byte> getRow(int y) const;
+    // Row y as typed pixels, e.g. glm::vec3 for RGB32F; Pixel must be const for const views
+    template<typename Pixel>
+    std::span<Pixel> getPixels(int y) const;
+};
+
+using BitmapView = BasicBitmapView<uint8_t>;
+using ConstBitmapView = BasicBitmapView<const uint8_t>;
+
 class Bitmap {
 public:
-    Bitmap() : width(0), height(0), depth(0) {}
-    explicit Bitmap(std::string_view fileName);
-    Bitmap(int width, int height, int depth);
+    Bitmap() : width(0), height(0), depth(0), format(BitmapFormat::RGB32F) {}
+    // Radiance (.hdr) files are decoded natively and in parallel, other formats through stb_image.
+    // Block-compressed formats are encoded after loading.
+    explicit Bitmap(std::string_view fileName, BitmapFormat format = BitmapFormat::RGB32F);
+    Bitmap(int width, int height, int depth, BitmapFormat format = BitmapFormat::RGB32F);
 
     Bitmap(const Bitmap&) = delete;
     Bitmap& operator=(const Bitmap&) = delete;
@@ -19,16 +102,138 @@ public:
     int getWidth() const { return width; }
     int getHeight() const { return height; }
     int getDepth() const { return depth; }
-    const float* getData() const { return data.data(); }
+    BitmapFormat getFormat() const { return format; }
+    const uint8_t* getData() const { return data.data(); }
+    uint8_t* getData() { return data.data(); }
+    size_t getByteSize() const { return data.size(); }
+
+    // Whole layer z, or a rectangle of it
+    BitmapView getView(int z = 0) { return getView(0, 0, width, height, z); }
+    ConstBitmapView getView(int z = 0) const { return getView(0, 0, width, height, z); }
+    BitmapView getView(int x, int y, int width, int height, int z = 0);
+    ConstBitmapView getView(int x, int y, int width, int height, int z = 0) const;
+    std::span<uint8_t> getRow(int y, int z = 0) { return getView(z).getRow(y); }
+    std::span<const uint8_t> getRow(int y, int z = 0) const { return getView(z).getRow(y); }
+    template<typename Pixel>
+    std::span<Pixel> getPixels(int y, int z = 0) { return getView(z).template getPixels<Pixel>(y); }
+    template<typename Pixel>
+    std::span<const Pixel> getPixels(int y, int z = 0) const { return getView(z).template getPixels<const Pixel>(y); }
+
+    // Single pixel access that decodes/encodes the format on every call; loops should use rows instead
     glm::vec3 getPixel(int x, int y, int z) const;
     void setPixel(int x, int y, int z, const glm::vec3& color);
 
+    static constexpr size_t getBytesPerPixel(BitmapFormat format)
+    {
+        switch (format) {
+        case BitmapFormat::RGB32F:
+            return 3 * sizeof(float);
+        case BitmapFormat::RGB16F:
+            return 3 * sizeof(uint16_t);
+        case BitmapFormat::R11G11B10F:
+        case BitmapFormat::RGBE8:
+        case BitmapFormat::RGBA8:
+            return sizeof(uint32_t);
+        default:
+            throw std::invalid_argument("invalid bitmap format");
+        }
+    }
+    static constexpr bool isBlockCompressed(BitmapFormat format)
+    {
+        return format == BitmapFormat::BC6H || format == BitmapFormat::BC7 || format == BitmapFormat::BC5 || format == BitmapFormat::BC4;
+    }
+    // Format a block-compressed format is encoded from and decoded to: RGB32F for BC6H and RGBA8 for the others.
+    // Uncompressed formats map to themselves.
+    static constexpr BitmapFormat getUncompressedFormat(BitmapFormat format)
+    {
+        if (!isBlockCompressed(format)) {
+            return format;
+        }
+        return format == BitmapFormat::BC6H ? BitmapFormat::RGB32F : BitmapFormat::RGBA8;
+    }
+    // Width and height of the pixel blocks a format stores together, 1 for uncompressed formats
+    static constexpr int getBlockSize(BitmapFormat format) { return isBlockCompressed(format) ? 4 : 1; }
+    // Bytes of one block of a block-compressed format
+    static constexpr size_t getBlockByteSize(BitmapFormat format) { return format == BitmapFormat::BC4 ? 8 : 16; }
+    // Bytes of one layer; partial blocks at the right and bottom edges take up whole blocks
+    static constexpr size_t getLayerByteSize(BitmapFormat format, int width, int height)
+    {
+        if (isBlockCompressed(format)) {
+            return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockByteSize(format);
+        }
+        return static_cast<size_t>(width) * height * getBytesPerPixel(format);
+    }
+
+    // Conversions from and to block-compressed formats run in parallel over rows of blocks
+    static Bitmap convertFormat(const Bitmap& bitmap, BitmapFormat format);
     static Bitmap convertEquirectangularMapToVerticalCross(const Bitmap& bitmap);
+    // Keeps the format of the cross, faces are copied row by row
     static Bitmap convertVerticalCrossToCubeMapFaces(const Bitmap& bitmap);
-    static Bitmap convertDiffuseToIrradiance(const Bitmap& input, int srcW, int srcH, int dstW, int dstH, int numMonteCarloSamples);
+    // Same result as the two conversions above, written straight into the face layout without the cross
+    static Bitmap convertEquirectangularMapToCubeMapFaces(const Bitmap& bitmap, BitmapFormat format = BitmapFormat::RGB32F);
+    // Same result as convertEquirectangularMapToCubeMapFaces(Bitmap(fileName), format). Radiance files whose
+    // decoded pixels exceed memoryBudget bytes are streamed instead: bands of at most memoryBudget bytes of
+    // source rows are decoded one after another, each filling the face texels that sample from it.
+    static Bitmap loadEquirectangularMapAsCubeMapFaces(std::string_view fileName, size_t memoryBudget, BitmapFormat format = BitmapFormat::RGB32F);
+    // True for the Radiance files that loadEquirectangularMapAsCubeMapFaces() streams for memoryBudget
+    static bool exceedsMemoryBudget(std::string_view fileName, size_t memoryBudget);
+    // Reduces an image by the smallest power of two that makes it at most maxWidth pixels wide, averaging blocks of pixels
+    static Bitmap downsample(Bitmap bitmap, int maxWidth);
+    // Same as downsample(Bitmap(fileName), maxWidth). Radiance files are streamed, so only the reduced image is
+    // held in memory as a whole.
+    static Bitmap loadDownsampled(std::string_view fileName, int maxWidth);
+    // Separable resampling of every layer to width x height, in parallel bands of rows. All channels,
+    // including the alpha of RGBA8, are filtered in linear float; negative results are clamped to 0.
+    static Bitmap resample(const Bitmap& bitmap, int width, int height, ResampleFilter filter,
+        ResampleEdge edgeX = ResampleEdge::Clamp, ResampleEdge edgeY = ResampleEdge::Clamp);
+    // Full mip chain down to 1x1, level 0 being the input converted to format. Each level is filtered from
+    // the one above it with edges clamped; odd sizes round down. Block-compressed chains are generated in
+    // getUncompressedFormat(format) and encoded level by level.
+    static std::vector<Bitmap> generateMips(const Bitmap& bitmap, ResampleFilter filter, BitmapFormat format = BitmapFormat::RGB32F,
+        MipContent content = MipContent::Linear);
+    // Loads every image file and generates its mip chain like generateMips(). Images are decoded concurrently,
+    // and each one's own parallel loops share the remaining threads.
+    static std::vector<std::vector<Bitmap>> loadMips(const std::vector<std::pair<std::string, MipContent>>& images, ResampleFilter filter,
+        BitmapFormat format = BitmapFormat::RGB32F);
+    // Same for the 6 faces of a cubemap, except that taps beyond a face edge read the neighbouring face,
+    // so the filter footprint is continuous across seams.
+    static std::vector<Bitmap> generateCubeMapMips(const Bitmap& faces, ResampleFilter filter, BitmapFormat format = BitmapFormat::RGB32F);
+    // Specular mip chain of GGX-prefiltered radiance for cubemap faces. Level m is filtered for perceptual
+    // roughness m / (numLevels - 1), the same mapping mesh.frag uses to pick the LOD; level 0 is the input.
+    static std::vector<Bitmap> convertCubeMapFacesToPrefilteredMips(const Bitmap& faces, int numLevels, int numSamples, BitmapFormat format = BitmapFormat::RGB32F);
+    static Bitmap convertDiffuseToIrradiance(const Bitmap& input, int srcW, int srcH, int dstW, int dstH, int numMonteCarloSamples,
+        IrradianceSampler sampler = IrradianceSampler::Uniform);
+    // Projects an equirectangular map onto 9 (L2) spherical harmonics coefficients that are already
+    // convolved with the cosine lobe and divided by pi, i.e. they evaluate to the same normalized
+    // irradiance as convertDiffuseToIrradiance. Directions are in cubemap sampling space.
+    static std::array<glm::vec3, 9> convertDiffuseToIrradianceSH(const Bitmap& input);
+    // Same as above for a file; Radiance files are streamed band by band instead of loading the whole map
+    static std::array<glm::vec3, 9> convertDiffuseToIrradianceSH(std::string_view fileName);
+
+    // Decodes a Radiance file top to bottom in bands of up to bandHeight rows, so only one band is held in
+    // memory. consumer receives each band in format, the index of its first row and the height of the image.
+    static void loadBands(std::string_view fileName, int bandHeight, BitmapFormat format,
+        const std::function<void(const Bitmap& band, int y, int height)>& consumer);
 private:
     int width;
     int height;
     int depth;
-    std::vector<float> data;
+    BitmapFormat format;
+    std::vector<uint8_t> data;
 };
+
+template<typename Byte>
+std::span<Byte> BasicBitmapView<Byte>::getRow(int y) const
+{
+    return std::span<Byte>(data + static_cast<size_t>(y) * rowStride, static_cast<size_t>(width) * Bitmap::getBytesPerPixel(format));
+}
+
+template<typename Byte>
+template<typename Pixel>
+std::span<Pixel> BasicBitmapView<Byte>::getPixels(int y) const
+{
+    if (sizeof(Pixel) != Bitmap::getBytesPerPixel(format)) {
+        throw std::invalid_argument("pixel type does not match bitmap format");
+    }
+    return std::span<Pixel>(reinterpret_cast<Pixel*>(data + static_cast<size_t>(y) * rowStride), width);
+}
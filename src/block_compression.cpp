@@ -0,0 +1,472 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <glm/gtc/packing.hpp>
+
+#include "block_compression.h"
+
+// Weights of 4-bit indices between the two endpoints, in 64ths
+static constexpr int indexWeights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static constexpr uint32_t bc6hMode11 = 0x03;
+static constexpr int bc6hEndpointBits = 10;
+static constexpr int bc6hMaxEndpoint = (1 << bc6hEndpointBits) - 1;
+// Least squares refits of the endpoints after the initial fit; each one is kept only if it lowers the error
+static constexpr int bc6hRefinements = 2;
+
+// Mode 6 is the bit pattern 0000001, least significant bit first
+static constexpr uint32_t bc7Mode6 = 0x40;
+static constexpr int bc7Mode6Bits = 7;
+static constexpr int bc7EndpointBits = 7;
+static constexpr int bc7Refinements = 2;
+
+// Writes bit fields into a zeroed block, least significant bit first
+struct BlockWriter {
+    std::span<uint8_t, blockCompressedBlockSize> block;
+    int position = 0;
+
+    void write(uint32_t value, int numBits)
+    {
+        for (int i = 0; i < numBits; i++, position++) {
+            if ((value >> i) & 1) {
+                block[position >> 3] |= static_cast<uint8_t>(1 << (position & 7));
+            }
+        }
+    }
+};
+
+struct BlockReader {
+    std::span<const uint8_t, blockCompressedBlockSize> block;
+    int position = 0;
+
+    uint32_t read(int numBits)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < numBits; i++, position++) {
+            value |= static_cast<uint32_t>((block[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+static int interpolate(int a, int b, int weight)
+{
+    return ((64 - weight) * a + weight * b + 32) >> 6;
+}
+
+// Expands a 10-bit endpoint to the 16-bit range the hardware interpolates in (unsigned BC6H)
+static int unquantizeBC6H(int value)
+{
+    if (value == 0) {
+        return 0;
+    }
+    if (value == bc6hMaxEndpoint) {
+        return 0xFFFF;
+    }
+    return ((value << 16) + 0x8000) >> bc6hEndpointBits;
+}
+
+// Half float bits of an interpolated value
+static int finishBC6H(int value)
+{
+    return (value * 31) >> 6;
+}
+
+// Nearest 10-bit endpoint to a value in interpolation space
+static int quantizeBC6H(float value)
+{
+    const int guess = std::clamp(static_cast<int>(std::lround((value - 32.0f) / 64.0f)), 0, bc6hMaxEndpoint);
+    int best = guess;
+    float bestError = std::numeric_limits<float>::max();
+    for (int q = std::max(guess - 1, 0); q <= std::min(guess + 1, bc6hMaxEndpoint); q++) {
+        const float error = std::abs(float(unquantizeBC6H(q)) - value);
+        if (error < bestError) {
+            best = q;
+            bestError = error;
+        }
+    }
+    return best;
+}
+
+static glm::ivec3 quantizeBC6H(const glm::vec3& value)
+{
+    return glm::ivec3(quantizeBC6H(value.r), quantizeBC6H(value.g), quantizeBC6H(value.b));
+}
+
+// Picks the closest palette entry for every texel and returns the summed squared error in half float bits
+static float assignIndicesBC6H(const std::array<glm::vec3, 16>& halves, const glm::ivec3& endpoint0, const glm::ivec3& endpoint1, std::array<int, 16>& indices)
+{
+    std::array<glm::vec3, 16> palette;
+    for (int k = 0; k < 16; k++) {
+        for (int c = 0; c < 3; c++) {
+            palette[k][c] = float(finishBC6H(interpolate(unquantizeBC6H(endpoint0[c]), unquantizeBC6H(endpoint1[c]), indexWeights4[k])));
+        }
+    }
+    float totalError = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float bestError = std::numeric_limits<float>::max();
+        for (int k = 0; k < 16; k++) {
+            const glm::vec3 difference = halves[i] - palette[k];
+            const float error = glm::dot(difference, difference);
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = k;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+void encodeBlockBC6H(std::span<const glm::vec3, 16> texels, std::span<uint8_t, blockCompressedBlockSize> block)
+{
+    // BC6H interpolates the bit patterns of half floats, so the fit runs on those, which is close to a
+    // logarithmic scale and spreads the error evenly over the dynamic range
+    std::array<glm::vec3, 16> halves;
+    std::array<glm::vec3, 16> targets;
+    for (int i = 0; i < 16; i++) {
+        for (int c = 0; c < 3; c++) {
+            const float value = texels[i][c] > 0.0f ? std::min(texels[i][c], 65504.0f) : 0.0f;
+            halves[i][c] = float(glm::packHalf1x16(value));
+        }
+        // Interpolation space, which finishBC6H scales by 31/64
+        targets[i] = halves[i] * (64.0f / 31.0f);
+    }
+
+    // Endpoints at the extremes of the texels along their principal axis, found by power iteration
+    glm::vec3 mean = glm::vec3(0.0f);
+    glm::vec3 minimum = targets[0];
+    glm::vec3 maximum = targets[0];
+    for (const glm::vec3& target : targets) {
+        mean += target / 16.0f;
+        minimum = glm::min(minimum, target);
+        maximum = glm::max(maximum, target);
+    }
+    glm::mat3 covariance = glm::mat3(0.0f);
+    for (const glm::vec3& target : targets) {
+        covariance += glm::outerProduct(target - mean, target - mean);
+    }
+    glm::vec3 axis = maximum - minimum;
+    for (int i = 0; i < 8 && glm::dot(axis, axis) > 0.0f; i++) {
+        axis = covariance * axis;
+        axis /= std::max(std::max(std::abs(axis.x), std::abs(axis.y)), std::max(std::abs(axis.z), 1e-30f));
+    }
+    if (glm::dot(axis, axis) > 0.0f) {
+        axis = glm::normalize(axis);
+    }
+    float low = 0.0f;
+    float high = 0.0f;
+    for (const glm::vec3& target : targets) {
+        const float t = glm::dot(target - mean, axis);
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    glm::ivec3 endpoint0 = quantizeBC6H(glm::clamp(mean + axis * low, 0.0f, 65535.0f));
+    glm::ivec3 endpoint1 = quantizeBC6H(glm::clamp(mean + axis * high, 0.0f, 65535.0f));
+    std::array<int, 16> indices;
+    float error = assignIndicesBC6H(halves, endpoint0, endpoint1, indices);
+
+    for (int refinement = 0; refinement < bc6hRefinements && error > 0.0f; refinement++) {
+        // Endpoints that minimize the squared error for the current indices
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        glm::vec3 at = glm::vec3(0.0f);
+        glm::vec3 bt = glm::vec3(0.0f);
+        for (int i = 0; i < 16; i++) {
+            const float b = float(indexWeights4[indices[i]]) / 64.0f;
+            const float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            at += a * targets[i];
+            bt += b * targets[i];
+        }
+        const float determinant = aa * bb - ab * ab;
+        if (determinant < 1e-6f) {
+            break;
+        }
+        const glm::ivec3 candidate0 = quantizeBC6H(glm::clamp((at * bb - bt * ab) / determinant, 0.0f, 65535.0f));
+        const glm::ivec3 candidate1 = quantizeBC6H(glm::clamp((bt * aa - at * ab) / determinant, 0.0f, 65535.0f));
+        std::array<int, 16> candidateIndices;
+        const float candidateError = assignIndicesBC6H(halves, candidate0, candidate1, candidateIndices);
+        if (candidateError >= error) {
+            break;
+        }
+        endpoint0 = candidate0;
+        endpoint1 = candidate1;
+        indices = candidateIndices;
+        error = candidateError;
+    }
+
+    // The first texel's index is stored without its high bit; the weights are symmetric, so swapping the
+    // endpoints and mirroring the indices decodes to exactly the same values
+    if (indices[0] >= 8) {
+        std::swap(endpoint0, endpoint1);
+        for (int& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    std::fill(block.begin(), block.end(), uint8_t(0));
+    BlockWriter writer{ block };
+    writer.write(bc6hMode11, 5);
+    for (const glm::ivec3& endpoint : { endpoint0, endpoint1 }) {
+        for (int c = 0; c < 3; c++) {
+            writer.write(static_cast<uint32_t>(endpoint[c]), bc6hEndpointBits);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        writer.write(static_cast<uint32_t>(indices[i]), i == 0 ? 3 : 4);
+    }
+}
+
+void decodeBlockBC6H(std::span<const uint8_t, blockCompressedBlockSize> block, std::span<glm::vec3, 16> texels)
+{
+    BlockReader reader{ block };
+    if (reader.read(5) != bc6hMode11) {
+        throw std::runtime_error("Unsupported BC6H block mode");
+    }
+    glm::ivec3 endpoints[2];
+    for (glm::ivec3& endpoint : endpoints) {
+        for (int c = 0; c < 3; c++) {
+            endpoint[c] = unquantizeBC6H(static_cast<int>(reader.read(bc6hEndpointBits)));
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        const int weight = indexWeights4[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 3; c++) {
+            texels[i][c] = glm::unpackHalf1x16(static_cast<uint16_t>(finishBC6H(interpolate(endpoints[0][c], endpoints[1][c], weight))));
+        }
+    }
+}
+
+// Mode 6 endpoint for a value in 0..255: 7 bits per channel followed by a p-bit shared by all channels
+static glm::ivec4 quantizeBC7(const glm::vec4& value, int pBit)
+{
+    glm::ivec4 endpoint;
+    for (int c = 0; c < 4; c++) {
+        const int quantized = static_cast<int>(std::lround((std::clamp(value[c], 0.0f, 255.0f) - float(pBit)) / 2.0f));
+        endpoint[c] = (std::clamp(quantized, 0, (1 << bc7EndpointBits) - 1) << 1) | pBit;
+    }
+    return endpoint;
+}
+
+// Picks the closest palette entry for every texel and returns the summed squared error
+static float assignIndicesBC7(const std::array<glm::vec4, 16>& targets, const glm::ivec4& endpoint0, const glm::ivec4& endpoint1, std::array<int, 16>& indices)
+{
+    std::array<glm::vec4, 16> palette;
+    for (int k = 0; k < 16; k++) {
+        for (int c = 0; c < 4; c++) {
+            palette[k][c] = float(interpolate(endpoint0[c], endpoint1[c], indexWeights4[k]));
+        }
+    }
+    float totalError = 0.0f;
+    for (int i = 0; i < 16; i++) {
+        float bestError = std::numeric_limits<float>::max();
+        for (int k = 0; k < 16; k++) {
+            const glm::vec4 difference = targets[i] - palette[k];
+            const float error = glm::dot(difference, difference);
+            if (error < bestError) {
+                bestError = error;
+                indices[i] = k;
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// Quantizes both endpoints with the combination of p-bits that fits the texels best
+static float quantizeEndpointsBC7(const std::array<glm::vec4, 16>& targets, const glm::vec4& value0, const glm::vec4& value1,
+    glm::ivec4& endpoint0, glm::ivec4& endpoint1, std::array<int, 16>& indices)
+{
+    float bestError = std::numeric_limits<float>::max();
+    for (int pBits = 0; pBits < 4; pBits++) {
+        const glm::ivec4 candidate0 = quantizeBC7(value0, pBits & 1);
+        const glm::ivec4 candidate1 = quantizeBC7(value1, pBits >> 1);
+        std::array<int, 16> candidateIndices;
+        const float error = assignIndicesBC7(targets, candidate0, candidate1, candidateIndices);
+        if (error < bestError) {
+            bestError = error;
+            endpoint0 = candidate0;
+            endpoint1 = candidate1;
+            indices = candidateIndices;
+        }
+    }
+    return bestError;
+}
+
+void encodeBlockBC7(std::span<const uint8_t, 64> texels, std::span<uint8_t, blockCompressedBlockSize> block)
+{
+    std::array<glm::vec4, 16> targets;
+    for (int i = 0; i < 16; i++) {
+        targets[i] = glm::vec4(texels[i * 4], texels[i * 4 + 1], texels[i * 4 + 2], texels[i * 4 + 3]);
+    }
+
+    // Endpoints at the extremes of the texels along their principal axis, as for BC6H
+    glm::vec4 mean = glm::vec4(0.0f);
+    glm::vec4 minimum = targets[0];
+    glm::vec4 maximum = targets[0];
+    for (const glm::vec4& target : targets) {
+        mean += target / 16.0f;
+        minimum = glm::min(minimum, target);
+        maximum = glm::max(maximum, target);
+    }
+    glm::mat4 covariance = glm::mat4(0.0f);
+    for (const glm::vec4& target : targets) {
+        covariance += glm::outerProduct(target - mean, target - mean);
+    }
+    glm::vec4 axis = maximum - minimum;
+    for (int i = 0; i < 8 && glm::dot(axis, axis) > 0.0f; i++) {
+        axis = covariance * axis;
+        axis /= std::max(std::max(std::max(std::abs(axis.x), std::abs(axis.y)), std::max(std::abs(axis.z), std::abs(axis.w))), 1e-30f);
+    }
+    if (glm::dot(axis, axis) > 0.0f) {
+        axis = glm::normalize(axis);
+    }
+    float low = 0.0f;
+    float high = 0.0f;
+    for (const glm::vec4& target : targets) {
+        const float t = glm::dot(target - mean, axis);
+        low = std::min(low, t);
+        high = std::max(high, t);
+    }
+    glm::ivec4 endpoint0;
+    glm::ivec4 endpoint1;
+    std::array<int, 16> indices;
+    float error = quantizeEndpointsBC7(targets, mean + axis * low, mean + axis * high, endpoint0, endpoint1, indices);
+
+    for (int refinement = 0; refinement < bc7Refinements && error > 0.0f; refinement++) {
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        glm::vec4 at = glm::vec4(0.0f);
+        glm::vec4 bt = glm::vec4(0.0f);
+        for (int i = 0; i < 16; i++) {
+            const float b = float(indexWeights4[indices[i]]) / 64.0f;
+            const float a = 1.0f - b;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            at += a * targets[i];
+            bt += b * targets[i];
+        }
+        const float determinant = aa * bb - ab * ab;
+        if (determinant < 1e-6f) {
+            break;
+        }
+        glm::ivec4 candidate0;
+        glm::ivec4 candidate1;
+        std::array<int, 16> candidateIndices;
+        const float candidateError = quantizeEndpointsBC7(targets, (at * bb - bt * ab) / determinant, (bt * aa - at * ab) / determinant,
+            candidate0, candidate1, candidateIndices);
+        if (candidateError >= error) {
+            break;
+        }
+        endpoint0 = candidate0;
+        endpoint1 = candidate1;
+        indices = candidateIndices;
+        error = candidateError;
+    }
+
+    // The first texel's index is stored without its high bit, see encodeBlockBC6H; the p-bits swap along
+    if (indices[0] >= 8) {
+        std::swap(endpoint0, endpoint1);
+        for (int& index : indices) {
+            index = 15 - index;
+        }
+    }
+
+    std::fill(block.begin(), block.end(), uint8_t(0));
+    BlockWriter writer{ block };
+    writer.write(bc7Mode6, bc7Mode6Bits);
+    for (int c = 0; c < 4; c++) {
+        writer.write(static_cast<uint32_t>(endpoint0[c] >> 1), bc7EndpointBits);
+        writer.write(static_cast<uint32_t>(endpoint1[c] >> 1), bc7EndpointBits);
+    }
+    writer.write(static_cast<uint32_t>(endpoint0.x & 1), 1);
+    writer.write(static_cast<uint32_t>(endpoint1.x & 1), 1);
+    for (int i = 0; i < 16; i++) {
+        writer.write(static_cast<uint32_t>(indices[i]), i == 0 ? 3 : 4);
+    }
+}
+
+void decodeBlockBC7(std::span<const uint8_t, blockCompressedBlockSize> block, std::span<uint8_t, 64> texels)
+{
+    BlockReader reader{ block };
+    if (reader.read(bc7Mode6Bits) != bc7Mode6) {
+        throw std::runtime_error("Unsupported BC7 block mode");
+    }
+    glm::ivec4 endpoints[2];
+    for (int c = 0; c < 4; c++) {
+        endpoints[0][c] = static_cast<int>(reader.read(bc7EndpointBits)) << 1;
+        endpoints[1][c] = static_cast<int>(reader.read(bc7EndpointBits)) << 1;
+    }
+    for (glm::ivec4& endpoint : endpoints) {
+        const int pBit = static_cast<int>(reader.read(1));
+        for (int c = 0; c < 4; c++) {
+            endpoint[c] |= pBit;
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        const int weight = indexWeights4[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; c++) {
+            texels[i * 4 + c] = static_cast<uint8_t>(interpolate(endpoints[0][c], endpoints[1][c], weight));
+        }
+    }
+}
+
+// Value of a BC4 palette entry. With red0 > red1 there are 6 interpolated values, otherwise 4 plus 0 and 255.
+static int getPaletteValueBC4(int red0, int red1, int index)
+{
+    if (index < 2) {
+        return index == 0 ? red0 : red1;
+    }
+    if (red0 > red1) {
+        return ((8 - index) * red0 + (index - 1) * red1 + 3) / 7;
+    }
+    if (index >= 6) {
+        return index == 6 ? 0 : 255;
+    }
+    return ((6 - index) * red0 + (index - 1) * red1 + 2) / 5;
+}
+
+void encodeBlockBC4(std::span<const uint8_t, 16> values, std::span<uint8_t, blockCompressedBC4BlockSize> block)
+{
+    // The 8-entry palette spans the range of the values; a single value is exact in either mode
+    const int red0 = *std::max_element(values.begin(), values.end());
+    const int red1 = *std::min_element(values.begin(), values.end());
+    uint64_t bits = static_cast<uint64_t>(red0) | static_cast<uint64_t>(red1) << 8;
+    for (int i = 0; i < 16; i++) {
+        int bestIndex = 0;
+        int bestError = std::numeric_limits<int>::max();
+        for (int k = 0; k < 8; k++) {
+            const int error = std::abs(getPaletteValueBC4(red0, red1, k) - values[i]);
+            if (error < bestError) {
+                bestError = error;
+                bestIndex = k;
+            }
+        }
+        bits |= static_cast<uint64_t>(bestIndex) << (16 + i * 3);
+    }
+    for (size_t i = 0; i < blockCompressedBC4BlockSize; i++) {
+        block[i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+}
+
+void decodeBlockBC4(std::span<const uint8_t, blockCompressedBC4BlockSize> block, std::span<uint8_t, 16> values)
+{
+    uint64_t bits = 0;
+    for (size_t i = 0; i < blockCompressedBC4BlockSize; i++) {
+        bits |= static_cast<uint64_t>(block[i]) << (i * 8);
+    }
+    const int red0 = static_cast<int>(bits & 0xFF);
+    const int red1 = static_cast<int>((bits >> 8) & 0xFF);
+    for (int i = 0; i < 16; i++) {
+        values[i] = static_cast<uint8_t>(getPaletteValueBC4(red0, red1, static_cast<int>((bits >> (16 + i * 3)) & 7)));
+    }
+}
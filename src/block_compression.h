@@ -0,0 +1,28 @@
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Size of one compressed block of 4x4 texels, for every format below except BC4
+constexpr size_t blockCompressedBlockSize = 16;
+constexpr size_t blockCompressedBC4BlockSize = 8;
+
+// BC6H (GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT) with texels in row-major order. Only mode 11 is written:
+// a single region with two 10-bit endpoints and 4-bit indices, which suits the smooth gradients of
+// environment maps. Negative and NaN components encode as 0, components above 65504 saturate.
+void encodeBlockBC6H(std::span<const glm::vec3, 16> texels, std::span<uint8_t, blockCompressedBlockSize> block);
+// Decodes blocks written by encodeBlockBC6H; throws std::runtime_error for the other modes
+void decodeBlockBC6H(std::span<const uint8_t, blockCompressedBlockSize> block, std::span<glm::vec3, 16> texels);
+
+// BC7 (GL_COMPRESSED_RGBA_BPTC_UNORM and its sRGB variant) of 8-bit RGBA texels in row-major order. Only mode 6
+// is written: a single region with 7-bit RGBA endpoints plus a p-bit each and 4-bit indices. Its color and alpha
+// share the indices, which suits material textures with opaque or smoothly varying alpha.
+void encodeBlockBC7(std::span<const uint8_t, 64> texels, std::span<uint8_t, blockCompressedBlockSize> block);
+// Decodes blocks written by encodeBlockBC7; throws std::runtime_error for the other modes
+void decodeBlockBC7(std::span<const uint8_t, blockCompressedBlockSize> block, std::span<uint8_t, 64> texels);
+
+// BC4 (GL_COMPRESSED_RED_RGTC1) of one 8-bit channel. BC5 (GL_COMPRESSED_RG_RGTC2) consists of two of these
+// blocks, red followed by green.
+void encodeBlockBC4(std::span<const uint8_t, 16> values, std::span<uint8_t, blockCompressedBC4BlockSize> block);
+void decodeBlockBC4(std::span<const uint8_t, blockCompressedBC4BlockSize> block, std::span<uint8_t, 16> values);
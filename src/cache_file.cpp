@@ -0,0 +1,41 @@
+#include <filesystem>
+#include <stdexcept>
+
+#include "cache_file.h"
+
+bool mapCacheFile(std::string_view fileName, MappedFile& file)
+{
+    if (!std::filesystem::exists(fileName)) {
+        return false;
+    }
+    try {
+        file = MappedFile(fileName);
+    }
+    catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool writeCacheFile(std::string_view fileName, const std::function<void(std::ofstream&)>& write)
+{
+    const std::filesystem::path path(fileName);
+    std::filesystem::path tempPath = path;
+    tempPath += ".tmp";
+    bool written;
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        write(file);
+        file.close();
+        written = !file.fail();
+    }
+    std::error_code error;
+    if (written) {
+        std::filesystem::rename(tempPath, path, error);
+    }
+    if (!written || error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
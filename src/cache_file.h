@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string_view>
+
+#include "mapped_file.h"
+
+// Maps fileName. Returns false if it does not exist or cannot be mapped.
+bool mapCacheFile(std::string_view fileName, MappedFile& file);
+
+// Maps a cache file and copies its fixed-size header, which has char magic[8], uint32_t version, uint64_t key and
+// uint64_t fileSize members. Returns false unless they match magic, version, key and the size of the file.
+template<typename Header>
+bool openCacheFile(std::string_view fileName, const char (&magic)[8], uint32_t version, uint64_t key, MappedFile& file, Header& header)
+{
+    if (!mapCacheFile(fileName, file) || file.getSize() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file.getData(), sizeof(header));
+    return std::memcmp(header.magic, magic, sizeof(magic)) == 0
+        && header.version == version
+        && header.key == key
+        && header.fileSize == file.getSize();
+}
+
+// Calls write with a stream to a temporary file that replaces fileName on success, so readers never see partial
+// files. Returns false if the cache could not be written.
+bool writeCacheFile(std::string_view fileName, const std::function<void(std::ofstream&)>& write);
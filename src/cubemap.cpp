@@ -1,85 +1,204 @@
 #include <stdexcept>
+#include <cassert>
+#include <cstring>
+#include <deque>
 #include <filesystem>
-#include <stb_image.h>
-#include <stb_image_write.h>
-#include <stb_image_resize2.h>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <span>
 #include <glm/ext.hpp>
 
 #include "bitmap.h"
+#include "cubemap_cache.h"
+#include "hash.h"
 
 #include "cubemap.h"
 
-Cubemap::Cubemap(std::string_view fileName)
-{
-    Bitmap diffuse(fileName);
-    Bitmap diffuseCross = Bitmap::convertEquirectangularMapToVerticalCross(diffuse);
-    Bitmap diffuseFaces = Bitmap::convertVerticalCrossToCubeMapFaces(diffuseCross);
+// Matches the std140 IrradianceData block (binding 1) in data/mesh.frag
+struct IrradianceData {
+    glm::vec4 sh[9];
+    int useIrradianceSH;
+};
 
-    api.glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &handleDiffuse);
-    api.glTextureParameteri(handleDiffuse, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleDiffuse, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleDiffuse, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleDiffuse, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    api.glTextureParameteri(handleDiffuse, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    api.glTextureStorage2D(handleDiffuse, 1, GL_RGB32F, diffuseFaces.getWidth(), diffuseFaces.getHeight());
-    const float* diffuseData = diffuseFaces.getData();
-    for (unsigned int face = 0; face < 6; face++) {
-        api.glTextureSubImage3D(handleDiffuse, 0, 0, 0, face, diffuseFaces.getWidth(), diffuseFaces.getHeight(), 1, GL_RGB, GL_FLOAT, diffuseData);
-        diffuseData += diffuseFaces.getWidth() * diffuseFaces.getHeight() * 3;
-    }
+// Smallest face size of the prefiltered specular mip chain; smaller faces cannot represent even the widest lobe
+static constexpr int minPrefilteredFaceSize = 8;
+// GGX samples per texel of the prefiltered mip levels
+static constexpr int numPrefilterSamples = 128;
+// Wider environment maps are reduced to this width before the irradiance is convolved from them
+static constexpr int maxIrradianceSourceWidth = 2048;
+// Resolution of the equirect the irradiance is convolved at, and its Monte Carlo sample count
+static constexpr int irradianceWidth = 256;
+static constexpr int irradianceHeight = 128;
+static constexpr int numIrradianceSamples = 256;
+// Samples of the preview irradiance map, and the factor by which each background refinement pass increases them
+static constexpr int numPreviewIrradianceSamples = 16;
+static constexpr int irradianceRefinementFactor = 4;
+// Every cosine-weighted sample contributes, so far fewer are needed than with the uniform sampler (compare in meshview_bench)
+static constexpr IrradianceSampler irradianceSampler = IrradianceSampler::CosineWeighted;
+// Largest slice an asynchronously loaded cubemap is staged in, and the bytes Cubemap::update() copies into its textures per call
+static constexpr size_t uploadBytesPerUpdate = 4 << 20;
+// Radiance of the 1x1 placeholder environment
+static constexpr float placeholderRadiance = 0.5f;
+// Bump whenever processing changes its output, so existing IBL caches are rebuilt
+static constexpr int processingVersion = 4;
+// Decoded source pixels held at once while processing, see Cubemap::setMemoryBudget()
+static std::atomic<size_t> memoryBudget = size_t(512) << 20;
 
-    Bitmap irradiance;
-    std::filesystem::path path(fileName);
-    std::string irradianceFileName = path.stem().string() + "_irradiance" + path.extension().string();
-    if (std::filesystem::exists(irradianceFileName)) {
-        irradiance = Bitmap(irradianceFileName);
-    }
-    else {
-        irradiance = Bitmap::convertDiffuseToIrradiance(diffuse, diffuse.getWidth(), diffuse.getHeight(), 256, 128, 1024);
-        stbi_write_hdr(irradianceFileName.c_str(), irradiance.getWidth(), irradiance.getHeight(), 3, irradiance.getData());
+// Shared by a Cubemap and the worker thread refining its preview irradiance map
+struct IrradianceRefinement {
+    // Only used by the worker: the preview data, kept until the refined result is written to the cache
+    CubemapData data;
+    std::mutex mutex;
+    // Irradiance faces of the latest pass that Cubemap::update() has not uploaded yet
+    std::optional<Bitmap> pendingFaces;
+    bool finished = false;
+    std::exception_ptr exception;
+    // Declared last, so the worker is stopped and joined before the members above are destroyed.
+    // A pass that is already running is finished first.
+    std::jthread thread;
+};
+
+// Part of one face set that is copied into a texture at once: numFaces whole faces from face on, or rows
+// [y, y + numRows) of a single face
+struct CubemapSlice {
+    int face;
+    int numFaces;
+    int y;
+    int numRows;
+};
+
+// A slice the load worker has written into staging memory
+struct CubemapStagedSlice {
+    UploadAllocation allocation;
+    // Index into CubemapData::diffuseLevels, or its size for the irradiance faces
+    size_t faceSet;
+    CubemapSlice slice;
+};
+
+// Shared by a Cubemap and the worker thread loading its data, see Cubemap::loadAsync()
+struct CubemapLoad {
+    ~CubemapLoad()
+    {
+        // Stop the worker first, so it queues no more slices after the remaining ones are discarded
+        thread.request_stop();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        for (const CubemapStagedSlice& staged : stagedSlices) {
+            uploader->discard(staged.allocation);
+        }
+        api.glDeleteTextures(1, &handleDiffuse);
+        api.glDeleteTextures(1, &handleIrradiance);
     }
-    Bitmap irradianceCross = Bitmap::convertEquirectangularMapToVerticalCross(irradiance);
-    Bitmap irradianceFaces = Bitmap::convertVerticalCrossToCubeMapFaces(irradianceCross);
 
-    api.glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &handleIrradiance);
-    api.glTextureParameteri(handleIrradiance, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleIrradiance, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleIrradiance, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-    api.glTextureParameteri(handleIrradiance, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    api.glTextureParameteri(handleIrradiance, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    api.glTextureStorage2D(handleIrradiance, 1, GL_RGB32F, irradianceFaces.getWidth(), irradianceFaces.getHeight());
-    const float* irradianceData = irradianceFaces.getData();
-    for (unsigned int face = 0; face < 6; face++) {
-        api.glTextureSubImage3D(handleIrradiance, 0, 0, 0, face, irradianceFaces.getWidth(), irradianceFaces.getHeight(), 1, GL_RGB, GL_FLOAT, irradianceData);
-        irradianceData += irradianceFaces.getWidth() * irradianceFaces.getHeight() * 3;
+    TextureUploader* uploader = nullptr;
+    std::mutex mutex;
+    // Set by the worker before it stages the faces, which it only reads from then on
+    std::optional<CubemapData> data;
+    // Slices that Cubemap::update() has not copied yet, in staging order
+    std::deque<CubemapStagedSlice> stagedSlices;
+    bool staged = false;
+    std::exception_ptr exception;
+    // Only used on the GL thread once data is set: the textures being uploaded
+    GLuint handleDiffuse = 0;
+    GLuint handleIrradiance = 0;
+    std::jthread thread;
+};
+
+struct GLTextureFormat {
+    GLenum internalFormat;
+    GLenum format;
+    GLenum type;
+};
+
+static CubemapData processEnvironmentMap(std::string_view fileName, IrradianceMode irradianceMode, BitmapFormat format, bool previewIrradiance);
+static BitmapFormat getProcessingFormat(BitmapFormat format);
+static Bitmap computeIrradianceFaces(const Bitmap& diffuse, int numSamples, BitmapFormat format);
+static void refineIrradiance(std::stop_token stopToken, IrradianceRefinement& refinement);
+static void stageCubemapData(std::stop_token stopToken, CubemapLoad& load, const CubemapData& data);
+static GLTextureFormat getGLTextureFormat(BitmapFormat format);
+static int getPrefilteredLevelCount(int faceSize);
+static CubemapFaces getCubemapFaces(const Bitmap& faces);
+static IrradianceData getIrradianceData(const CubemapData& data);
+static size_t getCubemapDataByteSize(const CubemapData& data);
+static GLuint createCubemapStorage(std::span<const CubemapFaces> levels);
+static GLuint createCubemapTexture(TextureUploader& uploader, std::span<const CubemapFaces> levels);
+static void uploadCubemapFaces(TextureUploader& uploader, GLuint handle, int level, const CubemapFaces& faces);
+static std::vector<CubemapSlice> sliceCubemapFaces(const CubemapFaces& faces, size_t maxBytes);
+static size_t getSliceByteSize(const CubemapFaces& faces, const CubemapSlice& slice);
+static const uint8_t* getSliceData(const CubemapFaces& faces, const CubemapSlice& slice);
+static TextureRegion getSliceRegion(GLuint handle, int level, const CubemapFaces& faces, const CubemapSlice& slice);
+
+Cubemap::Cubemap(std::string_view fileName, TextureUploader& uploader, IrradianceMode irradianceMode, BitmapFormat format)
+    : Cubemap(loadData(fileName, irradianceMode, format, true), uploader)
+{
+}
+
+Cubemap::Cubemap(CubemapData data, TextureUploader& uploader)
+    : uploader(&uploader), irradianceMode(data.irradianceMode), handleIrradiance(0), textureByteSize(getCubemapDataByteSize(data))
+{
+    handleDiffuse = createCubemapTexture(uploader, data.diffuseLevels);
+    if (irradianceMode == IrradianceMode::MonteCarlo) {
+        handleIrradiance = createCubemapTexture(uploader, { &data.irradianceFaces, 1 });
     }
+
+    // Updated when an asynchronously loaded cubemap replaces its placeholder
+    const IrradianceData irradianceData = getIrradianceData(data);
+    api.glCreateBuffers(1, &irradianceDataBuf);
+    api.glNamedBufferStorage(irradianceDataBuf, sizeof(IrradianceData), &irradianceData, GL_DYNAMIC_STORAGE_BIT);
+
+    startIrradianceRefinement(std::move(data));
 }
 
 Cubemap::~Cubemap()
 {
+    api.glDeleteBuffers(1, &irradianceDataBuf);
     api.glDeleteTextures(1, &handleIrradiance);
     api.glDeleteTextures(1, &handleDiffuse);
 }
 
-Cubemap::Cubemap(Cubemap&& other) noexcept : handleDiffuse(other.handleDiffuse), handleIrradiance(other.handleIrradiance)
+Cubemap::Cubemap(Cubemap&& other) noexcept
+    : uploader(other.uploader)
+    , irradianceMode(other.irradianceMode)
+    , handleDiffuse(other.handleDiffuse)
+    , handleIrradiance(other.handleIrradiance)
+    , irradianceDataBuf(other.irradianceDataBuf)
+    , textureByteSize(other.textureByteSize)
+    , irradianceRefinement(std::move(other.irradianceRefinement))
+    , cubemapLoad(std::move(other.cubemapLoad))
 {
     other.handleDiffuse = 0;
     other.handleIrradiance = 0;
+    other.irradianceDataBuf = 0;
 }
 
 Cubemap& Cubemap::operator=(Cubemap&& other) noexcept
 {
     if (this != &other) {
+        irradianceRefinement = std::move(other.irradianceRefinement);
+        cubemapLoad = std::move(other.cubemapLoad);
         if (handleDiffuse) {
             api.glDeleteTextures(1, &handleDiffuse);
         }
         if (handleIrradiance) {
             api.glDeleteTextures(1, &handleIrradiance);
         }
+        if (irradianceDataBuf) {
+            api.glDeleteBuffers(1, &irradianceDataBuf);
+        }
+        uploader = other.uploader;
+        irradianceMode = other.irradianceMode;
         handleDiffuse = other.handleDiffuse;
         other.handleDiffuse = 0;
         handleIrradiance = other.handleIrradiance;
         other.handleIrradiance = 0;
+        irradianceDataBuf = other.irradianceDataBuf;
+        other.irradianceDataBuf = 0;
+        textureByteSize = other.textureByteSize;
     }
     return *this;
 }
@@ -88,6 +207,187 @@ void Cubemap::bind() const
 {
     api.glBindTextures(5, 1, &handleDiffuse);
     api.glBindTextures(6, 1, &handleIrradiance);
+    api.glBindBufferBase(GL_UNIFORM_BUFFER, 1, irradianceDataBuf);
+}
+
+Cubemap Cubemap::loadAsync(std::string_view fileName, TextureUploader& uploader, IrradianceMode irradianceMode, BitmapFormat format)
+{
+    // Neutral grey environment for both lookups, so meshes are lit evenly until the data is loaded
+    Bitmap placeholder(1, 1, 6);
+    for (int face = 0; face < 6; face++) {
+        placeholder.setPixel(0, 0, face, glm::vec3(placeholderRadiance));
+    }
+    CubemapData placeholderData;
+    placeholderData.diffuseLevels.push_back(getCubemapFaces(placeholder));
+    placeholderData.irradianceFaces = getCubemapFaces(placeholder);
+    Cubemap cubemap(std::move(placeholderData), uploader);
+
+    cubemap.cubemapLoad = std::make_unique<CubemapLoad>();
+    cubemap.cubemapLoad->uploader = &uploader;
+    cubemap.cubemapLoad->thread = std::jthread([&load = *cubemap.cubemapLoad, fileName = std::string(fileName), irradianceMode, format](std::stop_token stopToken) {
+        try {
+            CubemapData loaded = loadData(fileName, irradianceMode, format, true);
+            const CubemapData* data;
+            {
+                std::lock_guard<std::mutex> lock(load.mutex);
+                load.data = std::move(loaded);
+                data = &*load.data;
+            }
+            stageCubemapData(stopToken, load, *data);
+            std::lock_guard<std::mutex> lock(load.mutex);
+            load.staged = true;
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(load.mutex);
+            load.exception = std::current_exception();
+        }
+    });
+    return cubemap;
+}
+
+bool Cubemap::update()
+{
+    const bool replaced = cubemapLoad && continueLoad();
+    if (irradianceRefinement) {
+        refreshIrradiance();
+    }
+    return replaced;
+}
+
+bool Cubemap::continueLoad()
+{
+    CubemapLoad& load = *cubemapLoad;
+    std::exception_ptr exception;
+    const CubemapData* data = nullptr;
+    std::vector<CubemapStagedSlice> slices;
+    bool staged = false;
+    {
+        std::lock_guard<std::mutex> lock(load.mutex);
+        exception = load.exception;
+        if (!exception && load.data) {
+            data = &*load.data;
+            // Copies up to the budget, but at least one slice per call
+            size_t budget = uploadBytesPerUpdate;
+            while (!load.stagedSlices.empty() && budget > 0) {
+                budget -= std::min(budget, load.stagedSlices.front().allocation.size);
+                slices.push_back(load.stagedSlices.front());
+                load.stagedSlices.pop_front();
+            }
+            staged = load.staged && load.stagedSlices.empty();
+        }
+    }
+    if (exception) {
+        cubemapLoad.reset();
+        std::rethrow_exception(exception);
+    }
+    if (!data) {
+        return false;
+    }
+
+    // The worker still reads the faces, but not the layout the storage is created from
+    if (!load.handleDiffuse) {
+        load.handleDiffuse = createCubemapStorage(data->diffuseLevels);
+        if (data->irradianceMode == IrradianceMode::MonteCarlo) {
+            load.handleIrradiance = createCubemapStorage({ &data->irradianceFaces, 1 });
+        }
+    }
+    for (const CubemapStagedSlice& stagedSlice : slices) {
+        const bool isIrradiance = stagedSlice.faceSet == data->diffuseLevels.size();
+        const CubemapFaces& faces = isIrradiance ? data->irradianceFaces : data->diffuseLevels[stagedSlice.faceSet];
+        const GLuint handle = isIrradiance ? load.handleIrradiance : load.handleDiffuse;
+        const int level = isIrradiance ? 0 : static_cast<int>(stagedSlice.faceSet);
+        uploader->copy(stagedSlice.allocation, getSliceRegion(handle, level, faces, stagedSlice.slice));
+    }
+    if (!staged) {
+        return false;
+    }
+
+    // Replace the placeholder
+    api.glDeleteTextures(1, &handleDiffuse);
+    api.glDeleteTextures(1, &handleIrradiance);
+    handleDiffuse = std::exchange(load.handleDiffuse, 0);
+    handleIrradiance = std::exchange(load.handleIrradiance, 0);
+    irradianceMode = load.data->irradianceMode;
+    textureByteSize = getCubemapDataByteSize(*load.data);
+    const IrradianceData irradianceData = getIrradianceData(*load.data);
+    api.glNamedBufferSubData(irradianceDataBuf, 0, sizeof(IrradianceData), &irradianceData);
+    startIrradianceRefinement(std::move(*load.data));
+    cubemapLoad.reset();
+    return true;
+}
+
+void Cubemap::startIrradianceRefinement(CubemapData data)
+{
+    if (data.irradiancePreview) {
+        irradianceRefinement = std::make_unique<IrradianceRefinement>();
+        irradianceRefinement->data = std::move(data);
+        irradianceRefinement->thread = std::jthread(refineIrradiance, std::ref(*irradianceRefinement));
+    }
+}
+
+void Cubemap::refreshIrradiance()
+{
+    std::optional<Bitmap> faces;
+    std::exception_ptr exception;
+    bool finished;
+    {
+        std::lock_guard<std::mutex> lock(irradianceRefinement->mutex);
+        faces = std::exchange(irradianceRefinement->pendingFaces, std::nullopt);
+        exception = irradianceRefinement->exception;
+        finished = irradianceRefinement->finished;
+    }
+    if (exception) {
+        irradianceRefinement.reset();
+        std::rethrow_exception(exception);
+    }
+    // Every pass has the face size of the preview, so it fits the immutable storage of the texture
+    if (faces) {
+        uploadCubemapFaces(*uploader, handleIrradiance, 0, getCubemapFaces(*faces));
+    }
+    if (finished) {
+        irradianceRefinement.reset();
+    }
+}
+
+CubemapData Cubemap::loadData(std::string_view fileName, IrradianceMode irradianceMode, BitmapFormat format, bool previewIrradiance)
+{
+    // Everything besides the file contents that affects the processed data
+    const int32_t parameters[] = {
+        processingVersion,
+        static_cast<int32_t>(irradianceMode),
+        static_cast<int32_t>(format),
+        minPrefilteredFaceSize,
+        maxIrradianceSourceWidth,
+        numPrefilterSamples,
+        irradianceWidth,
+        irradianceHeight,
+        numIrradianceSamples,
+        static_cast<int32_t>(irradianceSampler)
+    };
+    const uint64_t key = hashBytes(parameters, sizeof(parameters), hashFile(fileName));
+    const std::string cacheFileName = std::filesystem::path(fileName).stem().string() + ".iblcache";
+    if (std::optional<CubemapData> cached = readCubemapCache(cacheFileName, key)) {
+        return std::move(*cached);
+    }
+    CubemapData data = processEnvironmentMap(fileName, irradianceMode, format, previewIrradiance);
+    if (data.irradiancePreview) {
+        data.irradiancePreview->cacheFileName = cacheFileName;
+        data.irradiancePreview->cacheKey = key;
+        return data;
+    }
+    // Without a cache the next start simply processes the map again
+    writeCubemapCache(cacheFileName, key, data);
+    return data;
+}
+
+void Cubemap::setMemoryBudget(size_t bytes)
+{
+    memoryBudget = bytes;
+}
+
+size_t Cubemap::getMemoryBudget()
+{
+    return memoryBudget;
 }
 
 glm::vec3 Cubemap::faceCoordsToXYZ(int x, int y, CubemapFace face, int faceSize)
@@ -111,3 +411,253 @@ glm::vec3 Cubemap::faceCoordsToXYZ(int x, int y, CubemapFace face, int faceSize)
         throw std::invalid_argument("invalid face");
     }
 }
+
+static CubemapData processEnvironmentMap(std::string_view fileName, IrradianceMode irradianceMode, BitmapFormat format, bool previewIrradiance)
+{
+    // Maps within the memory budget are decoded once for all stages. Every stage streams larger maps from the
+    // file itself, so they are never decoded as a whole.
+    std::optional<Bitmap> source;
+    if (!Bitmap::exceedsMemoryBudget(fileName, Cubemap::getMemoryBudget())) {
+        source = Bitmap(fileName);
+    }
+    CubemapData data;
+    data.irradianceMode = irradianceMode;
+    {
+        // Roughness-indexed mip chain for the specular lookup in mesh.frag
+        const Bitmap diffuseFaces = source ? Bitmap::convertEquirectangularMapToCubeMapFaces(*source)
+            : Bitmap::loadEquirectangularMapAsCubeMapFaces(fileName, Cubemap::getMemoryBudget());
+        data.bitmaps = Bitmap::convertCubeMapFacesToPrefilteredMips(
+            diffuseFaces, getPrefilteredLevelCount(diffuseFaces.getWidth()), numPrefilterSamples, getProcessingFormat(format));
+        for (Bitmap& level : data.bitmaps) {
+            if (level.getFormat() != format) {
+                level = Bitmap::convertFormat(level, format);
+            }
+        }
+    }
+    if (irradianceMode == IrradianceMode::SphericalHarmonics) {
+        data.irradianceSH = source ? Bitmap::convertDiffuseToIrradianceSH(*source) : Bitmap::convertDiffuseToIrradianceSH(fileName);
+    }
+    else {
+        // The irradiance is far smoother than the texels of any environment map, so a reduced copy suffices
+        Bitmap diffuse = source ? Bitmap::downsample(std::move(*source), maxIrradianceSourceWidth) : Bitmap::loadDownsampled(fileName, maxIrradianceSourceWidth);
+        previewIrradiance = previewIrradiance && numPreviewIrradianceSamples < numIrradianceSamples;
+        const int numSamples = previewIrradiance ? numPreviewIrradianceSamples : numIrradianceSamples;
+        data.bitmaps.push_back(computeIrradianceFaces(diffuse, numSamples, format));
+        data.irradianceFaces = getCubemapFaces(data.bitmaps.back());
+        if (previewIrradiance) {
+            data.irradiancePreview = IrradiancePreview{ std::move(diffuse), numSamples };
+        }
+    }
+    // Moving bitmaps keeps their pixels in place, so the views stay valid when data is moved
+    const size_t numLevels = data.bitmaps.size() - (irradianceMode == IrradianceMode::MonteCarlo ? 1 : 0);
+    for (size_t level = 0; level < numLevels; level++) {
+        data.diffuseLevels.push_back(getCubemapFaces(data.bitmaps[level]));
+    }
+    return data;
+}
+
+static Bitmap computeIrradianceFaces(const Bitmap& diffuse, int numSamples, BitmapFormat format)
+{
+    const Bitmap irradiance = Bitmap::convertDiffuseToIrradiance(
+        diffuse, diffuse.getWidth(), diffuse.getHeight(), irradianceWidth, irradianceHeight, numSamples, irradianceSampler);
+    Bitmap faces = Bitmap::convertEquirectangularMapToCubeMapFaces(irradiance, getProcessingFormat(format));
+    if (faces.getFormat() != format) {
+        faces = Bitmap::convertFormat(faces, format);
+    }
+    return faces;
+}
+
+// Block-compressed textures are processed as half floats, which hold everything BC6H can represent, and encoded afterwards
+static BitmapFormat getProcessingFormat(BitmapFormat format)
+{
+    return Bitmap::isBlockCompressed(format) ? BitmapFormat::RGB16F : format;
+}
+
+// Recomputes the irradiance with more samples per pass until it matches what loadData produces without a preview,
+// then writes the cache. Each pass is handed to Cubemap::update() for upload.
+static void refineIrradiance(std::stop_token stopToken, IrradianceRefinement& refinement)
+{
+    CubemapData& data = refinement.data;
+    const IrradiancePreview& preview = *data.irradiancePreview;
+    const BitmapFormat format = data.irradianceFaces.format;
+    try {
+        for (int numSamples = preview.numSamples; numSamples < numIrradianceSamples && !stopToken.stop_requested();) {
+            numSamples = std::min(numSamples * irradianceRefinementFactor, numIrradianceSamples);
+            Bitmap faces = computeIrradianceFaces(preview.source, numSamples, format);
+            if (numSamples == numIrradianceSamples) {
+                data.irradianceFaces = getCubemapFaces(faces);
+                writeCubemapCache(preview.cacheFileName, preview.cacheKey, data);
+            }
+            std::lock_guard<std::mutex> lock(refinement.mutex);
+            refinement.pendingFaces = std::move(faces);
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(refinement.mutex);
+        refinement.exception = std::current_exception();
+    }
+    // Nothing refers to the preview data anymore
+    data = CubemapData();
+    std::lock_guard<std::mutex> lock(refinement.mutex);
+    refinement.finished = true;
+}
+
+// Writes the faces into staging memory slice by slice and queues the slices for Cubemap::update().
+// Returns early once stopToken is triggered.
+static void stageCubemapData(std::stop_token stopToken, CubemapLoad& load, const CubemapData& data)
+{
+    std::vector<CubemapFaces> faceSets = data.diffuseLevels;
+    if (data.irradianceMode == IrradianceMode::MonteCarlo) {
+        faceSets.push_back(data.irradianceFaces);
+    }
+    for (size_t faceSet = 0; faceSet < faceSets.size(); faceSet++) {
+        for (const CubemapSlice& slice : sliceCubemapFaces(faceSets[faceSet], uploadBytesPerUpdate)) {
+            const size_t size = getSliceByteSize(faceSets[faceSet], slice);
+            std::optional<UploadAllocation> allocation = load.uploader->allocate(size, stopToken);
+            if (!allocation) {
+                return;
+            }
+            std::memcpy(allocation->data, getSliceData(faceSets[faceSet], slice), size);
+            std::lock_guard<std::mutex> lock(load.mutex);
+            load.stagedSlices.push_back({ *allocation, faceSet, slice });
+        }
+    }
+}
+
+static IrradianceData getIrradianceData(const CubemapData& data)
+{
+    IrradianceData irradianceData = {};
+    if (data.irradianceMode == IrradianceMode::SphericalHarmonics) {
+        for (int i = 0; i < 9; i++) {
+            irradianceData.sh[i] = glm::vec4(data.irradianceSH[i], 0.0f);
+        }
+        irradianceData.useIrradianceSH = 1;
+    }
+    return irradianceData;
+}
+
+static size_t getCubemapDataByteSize(const CubemapData& data)
+{
+    size_t size = data.irradianceMode == IrradianceMode::MonteCarlo ? data.irradianceFaces.getByteSize() : 0;
+    for (const CubemapFaces& level : data.diffuseLevels) {
+        size += level.getByteSize();
+    }
+    return size;
+}
+
+static GLTextureFormat getGLTextureFormat(BitmapFormat format)
+{
+    switch (format) {
+    case BitmapFormat::RGB32F:
+        return { GL_RGB32F, GL_RGB, GL_FLOAT };
+    case BitmapFormat::RGB16F:
+        return { GL_RGB16F, GL_RGB, GL_HALF_FLOAT };
+    case BitmapFormat::R11G11B10F:
+        return { GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV };
+    case BitmapFormat::BC6H:
+        // Compressed uploads only take the internal format
+        return { GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 0, 0 };
+    default:
+        throw std::invalid_argument("bitmap format cannot be uploaded as a texture");
+    }
+}
+
+static int getPrefilteredLevelCount(int faceSize)
+{
+    int count = 1;
+    while ((faceSize >> count) >= minPrefilteredFaceSize) {
+        count++;
+    }
+    return count;
+}
+
+static CubemapFaces getCubemapFaces(const Bitmap& faces)
+{
+    assert(faces.getDepth() == 6 && faces.getWidth() == faces.getHeight());
+    return CubemapFaces{ faces.getData(), faces.getWidth(), faces.getFormat() };
+}
+
+// Creates an immutable cubemap with one texture level per entry of levels, without uploading them
+static GLuint createCubemapStorage(std::span<const CubemapFaces> levels)
+{
+    const GLTextureFormat format = getGLTextureFormat(levels[0].format);
+    GLuint handle;
+    api.glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &handle);
+    api.glTextureParameteri(handle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    api.glTextureParameteri(handle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    api.glTextureParameteri(handle, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
+    api.glTextureParameteri(handle, GL_TEXTURE_MIN_FILTER, levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    api.glTextureParameteri(handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    api.glTextureStorage2D(handle, static_cast<GLsizei>(levels.size()), format.internalFormat, levels[0].faceSize, levels[0].faceSize);
+    return handle;
+}
+
+static GLuint createCubemapTexture(TextureUploader& uploader, std::span<const CubemapFaces> levels)
+{
+    const GLuint handle = createCubemapStorage(levels);
+    for (size_t level = 0; level < levels.size(); level++) {
+        uploadCubemapFaces(uploader, handle, static_cast<int>(level), levels[level]);
+    }
+    return handle;
+}
+
+// All six faces in one copy
+static void uploadCubemapFaces(TextureUploader& uploader, GLuint handle, int level, const CubemapFaces& faces)
+{
+    const CubemapSlice slice = { 0, 6, 0, faces.faceSize };
+    uploader.upload(getSliceRegion(handle, level, faces, slice), faces.data, faces.getByteSize());
+}
+
+// As many whole faces as fit maxBytes, or rows of single faces (whole rows of blocks, for compressed formats) if
+// not even one face fits. Every slice holds at least one row.
+static std::vector<CubemapSlice> sliceCubemapFaces(const CubemapFaces& faces, size_t maxBytes)
+{
+    std::vector<CubemapSlice> slices;
+    const size_t faceByteSize = faces.getFaceByteSize();
+    if (faceByteSize <= maxBytes) {
+        const int facesPerSlice = static_cast<int>(std::min<size_t>(maxBytes / faceByteSize, 6));
+        for (int face = 0; face < 6; face += facesPerSlice) {
+            slices.push_back({ face, std::min(facesPerSlice, 6 - face), 0, faces.faceSize });
+        }
+        return slices;
+    }
+    const int blockSize = Bitmap::getBlockSize(faces.format);
+    const size_t rowSize = Bitmap::getLayerByteSize(faces.format, faces.faceSize, blockSize);
+    const int rowsPerSlice = std::max(static_cast<int>(maxBytes / rowSize), 1) * blockSize;
+    for (int face = 0; face < 6; face++) {
+        for (int y = 0; y < faces.faceSize; y += rowsPerSlice) {
+            slices.push_back({ face, 1, y, std::min(rowsPerSlice, faces.faceSize - y) });
+        }
+    }
+    return slices;
+}
+
+static size_t getSliceByteSize(const CubemapFaces& faces, const CubemapSlice& slice)
+{
+    return slice.numFaces * Bitmap::getLayerByteSize(faces.format, faces.faceSize, slice.numRows);
+}
+
+static const uint8_t* getSliceData(const CubemapFaces& faces, const CubemapSlice& slice)
+{
+    const int blockSize = Bitmap::getBlockSize(faces.format);
+    const size_t rowSize = Bitmap::getLayerByteSize(faces.format, faces.faceSize, blockSize);
+    return faces.getFace(slice.face) + slice.y / blockSize * rowSize;
+}
+
+static TextureRegion getSliceRegion(GLuint handle, int level, const CubemapFaces& faces, const CubemapSlice& slice)
+{
+    const GLTextureFormat format = getGLTextureFormat(faces.format);
+    TextureRegion region;
+    region.handle = handle;
+    region.target = GL_TEXTURE_CUBE_MAP;
+    region.level = level;
+    region.y = slice.y;
+    region.z = slice.face;
+    region.width = faces.faceSize;
+    region.height = slice.numRows;
+    region.depth = slice.numFaces;
+    // Compressed copies only take the internal format
+    region.format = Bitmap::isBlockCompressed(faces.format) ? format.internalFormat : format.format;
+    region.type = format.type;
+    return region;
+}
@@ -1,8 +1,22 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 #include "gl/gl.h"
+#include "bitmap.h"
+#include "mapped_file.h"
+#include "texture_upload.h"
+
+enum class IrradianceMode {
+    // Monte Carlo convolved irradiance cubemap, sampled per fragment
+    MonteCarlo,
+    // 9 spherical harmonics coefficients evaluated in the shader, no irradiance texture
+    SphericalHarmonics
+};
 
 enum class CubemapFace : int {
     PositiveX = 0,
@@ -13,9 +27,54 @@ enum class CubemapFace : int {
     NegativeZ
 };
 
+// Six square faces stored back to back in CubemapFace order, i.e. one level of a cubemap texture
+struct CubemapFaces {
+    const uint8_t* data = nullptr;
+    int faceSize = 0;
+    BitmapFormat format = BitmapFormat::RGB32F;
+
+    size_t getFaceByteSize() const { return Bitmap::getLayerByteSize(format, faceSize, faceSize); }
+    size_t getByteSize() const { return 6 * getFaceByteSize(); }
+    const uint8_t* getFace(int face) const { return data + face * getFaceByteSize(); }
+};
+
+// Returned by Cubemap::loadData instead of the final irradiance, which a Cubemap then refines in the background
+struct IrradiancePreview {
+    // Environment map the irradiance is convolved from
+    Bitmap source;
+    // Monte Carlo samples per texel the preview irradiance faces were computed with
+    int numSamples = 0;
+    // Cache entry that is written once the irradiance is fully refined
+    std::string cacheFileName;
+    uint64_t cacheKey = 0;
+};
+
+// Everything a Cubemap uploads, as produced on the CPU from an environment map or read from the IBL cache
+struct CubemapData {
+    IrradianceMode irradianceMode = IrradianceMode::MonteCarlo;
+    // GGX-prefiltered specular mip chain, largest level first
+    std::vector<CubemapFaces> diffuseLevels;
+    // MonteCarlo mode only
+    CubemapFaces irradianceFaces;
+    // SphericalHarmonics mode only
+    std::array<glm::vec3, 9> irradianceSH = {};
+    // Set if irradianceFaces are only a preview
+    std::optional<IrradiancePreview> irradiancePreview;
+    // Own the pixels the faces point to: bitmaps for processed data, the mapped file for cached data
+    std::vector<Bitmap> bitmaps;
+    MappedFile mappedFile;
+};
+
+struct IrradianceRefinement;
+struct CubemapLoad;
+
 class Cubemap {
 public:
-    explicit Cubemap(std::string_view fileName);
+    // Loads with a preview irradiance map if the IBL cache is cold, see update(). All textures are uploaded
+    // through uploader, which has to outlive the Cubemap.
+    explicit Cubemap(std::string_view fileName, TextureUploader& uploader, IrradianceMode irradianceMode = IrradianceMode::MonteCarlo, BitmapFormat format = BitmapFormat::RGB16F);
+    // If data holds an irradiance preview, a worker thread starts refining it
+    explicit Cubemap(CubemapData data, TextureUploader& uploader);
     ~Cubemap();
 
     Cubemap(const Cubemap&) = delete;
@@ -26,11 +85,48 @@ public:
 
     GLuint getHandleDiffuse() const { return handleDiffuse; }
     GLuint getHandleIrradiance() const { return handleIrradiance; }
+    IrradianceMode getIrradianceMode() const { return irradianceMode; }
+    // Bytes of texture data in both cubemaps, as uploaded; the placeholder's while loading
+    size_t getTextureByteSize() const { return textureByteSize; }
 
     void bind() const;
+    // Call once per frame on the GL thread; rethrows errors of the worker threads.
+    // Copies the next slices of asynchronously loaded data that the worker staged in the uploader, and uploads the
+    // latest refined irradiance map into the existing irradiance texture if the worker finished another pass since the last call.
+    // Returns true when loaded textures replaced the placeholder, which then have to be bound again.
+    bool update();
+    bool isLoading() const { return cubemapLoad != nullptr; }
+    bool isRefiningIrradiance() const { return irradianceRefinement != nullptr; }
+
+    // Returns a Cubemap with a 1x1 placeholder environment right away and loads the data on a worker thread,
+    // which also writes it into the staging memory of uploader. update() only issues the copies, in slices, so
+    // no single frame waits for the whole upload.
+    static Cubemap loadAsync(std::string_view fileName, TextureUploader& uploader, IrradianceMode irradianceMode = IrradianceMode::MonteCarlo, BitmapFormat format = BitmapFormat::RGB16F);
 
+    // Processes an environment map, unless <stem>.iblcache in the working directory was written for the
+    // same file contents and parameters, in which case the processed data is read from there.
+    // format selects the pixel format of both cubemap textures; RGBE8 and RGBA8 cannot be uploaded. BC6H is
+    // encoded on the CPU after processing and cuts the texture memory to a sixth of RGB16F.
+    // With previewIrradiance, processing stops at a quick low sample count irradiance map and leaves writing
+    // the cache to the refinement of a Cubemap created from the data.
+    static CubemapData loadData(std::string_view fileName, IrradianceMode irradianceMode, BitmapFormat format, bool previewIrradiance = false);
+    // Bytes of decoded environment map pixels that processing holds at once, 512 MiB by default. Radiance maps
+    // above the budget are streamed from the file in bands; the budget does not cover the processed cubemaps.
+    static void setMemoryBudget(size_t bytes);
+    static size_t getMemoryBudget();
     static glm::vec3 faceCoordsToXYZ(int x, int y, CubemapFace face, int faceSize);
 private:
+    // Return true when the loaded textures replaced the placeholder
+    bool continueLoad();
+    void startIrradianceRefinement(CubemapData data);
+    void refreshIrradiance();
+
+    TextureUploader* uploader;
+    IrradianceMode irradianceMode;
     GLuint handleDiffuse;
     GLuint handleIrradiance;
+    GLuint irradianceDataBuf;
+    size_t textureByteSize;
+    std::unique_ptr<IrradianceRefinement> irradianceRefinement;
+    std::unique_ptr<CubemapLoad> cubemapLoad;
 };
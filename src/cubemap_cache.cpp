@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "cache_file.h"
+#include "cubemap_cache.h"
+
+// Bump whenever the file layout changes
+static constexpr uint32_t cacheVersion = 2;
+static constexpr char cacheMagic[8] = { 'M', 'V', 'I', 'B', 'L', 'C', 'A', 'C' };
+// Payloads start at multiples of this, so each face set begins on its own page of the mapped file
+static constexpr uint64_t cachePageSize = 4096;
+
+// Fixed-size file header. It is followed by the specular levels (largest first) and then the
+// irradiance faces (MonteCarlo mode only), each starting at the next multiple of cachePageSize.
+struct CubemapCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t irradianceMode;
+    uint64_t key;
+    uint32_t format;
+    int32_t numLevels;
+    int32_t faceSize;
+    int32_t irradianceFaceSize;
+    float irradianceSH[27];
+    uint64_t fileSize;
+};
+
+static uint64_t alignToPage(uint64_t offset)
+{
+    return (offset + cachePageSize - 1) / cachePageSize * cachePageSize;
+}
+
+// Face sets of the cache in file order
+static std::vector<CubemapFaces> getCachedFaces(const CubemapData& data)
+{
+    std::vector<CubemapFaces> faces = data.diffuseLevels;
+    if (data.irradianceMode == IrradianceMode::MonteCarlo) {
+        faces.push_back(data.irradianceFaces);
+    }
+    return faces;
+}
+
+std::optional<CubemapData> readCubemapCache(std::string_view fileName, uint64_t key)
+{
+    CubemapData data;
+    CubemapCacheHeader header;
+    if (!openCacheFile(fileName, cacheMagic, cacheVersion, key, data.mappedFile, header)) {
+        return std::nullopt;
+    }
+    const uint8_t* fileData = data.mappedFile.getData();
+    const uint64_t fileSize = data.mappedFile.getSize();
+    if (header.numLevels < 1 || header.faceSize < 1 || header.irradianceFaceSize < 0
+        || header.format > static_cast<uint32_t>(BitmapFormat::BC6H)
+        || header.irradianceMode > static_cast<uint32_t>(IrradianceMode::SphericalHarmonics)
+        || (header.irradianceMode == static_cast<uint32_t>(IrradianceMode::MonteCarlo) && header.irradianceFaceSize < 1)) {
+        return std::nullopt;
+    }
+
+    data.irradianceMode = static_cast<IrradianceMode>(header.irradianceMode);
+    const BitmapFormat format = static_cast<BitmapFormat>(header.format);
+    for (int level = 0; level < header.numLevels; level++) {
+        data.diffuseLevels.push_back(CubemapFaces{ nullptr, std::max(header.faceSize >> level, 1), format });
+    }
+    if (data.irradianceMode == IrradianceMode::MonteCarlo) {
+        data.irradianceFaces = CubemapFaces{ nullptr, header.irradianceFaceSize, format };
+    }
+    std::memcpy(data.irradianceSH.data(), header.irradianceSH, sizeof(header.irradianceSH));
+
+    // Point the faces into the mapping; a file that does not end exactly after the last payload was not written by writeCubemapCache
+    uint64_t offset = sizeof(header);
+    auto mapFaces = [&](CubemapFaces& faces) {
+        offset = alignToPage(offset);
+        faces.data = offset + faces.getByteSize() <= fileSize ? fileData + offset : nullptr;
+        offset += faces.getByteSize();
+        return faces.data != nullptr;
+    };
+    for (CubemapFaces& faces : data.diffuseLevels) {
+        if (!mapFaces(faces)) {
+            return std::nullopt;
+        }
+    }
+    if (data.irradianceMode == IrradianceMode::MonteCarlo && !mapFaces(data.irradianceFaces)) {
+        return std::nullopt;
+    }
+    if (offset != fileSize) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+bool writeCubemapCache(std::string_view fileName, uint64_t key, const CubemapData& data)
+{
+    const std::vector<CubemapFaces> faces = getCachedFaces(data);
+    CubemapCacheHeader header = {};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.irradianceMode = static_cast<uint32_t>(data.irradianceMode);
+    header.key = key;
+    header.format = static_cast<uint32_t>(data.diffuseLevels[0].format);
+    header.numLevels = static_cast<int32_t>(data.diffuseLevels.size());
+    header.faceSize = data.diffuseLevels[0].faceSize;
+    header.irradianceFaceSize = data.irradianceFaces.faceSize;
+    std::memcpy(header.irradianceSH, data.irradianceSH.data(), sizeof(header.irradianceSH));
+    header.fileSize = sizeof(header);
+    for (const CubemapFaces& faceSet : faces) {
+        header.fileSize = alignToPage(header.fileSize) + faceSet.getByteSize();
+    }
+
+    return writeCacheFile(fileName, [&](std::ofstream& file) {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        const std::vector<char> padding(cachePageSize, 0);
+        uint64_t offset = sizeof(header);
+        for (const CubemapFaces& faceSet : faces) {
+            file.write(padding.data(), alignToPage(offset) - offset);
+            file.write(reinterpret_cast<const char*>(faceSet.data), faceSet.getByteSize());
+            offset = alignToPage(offset) + faceSet.getByteSize();
+        }
+    });
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "cubemap.h"
+
+// Returns the cached data if the file exists, is complete and was written for key
+std::optional<CubemapData> readCubemapCache(std::string_view fileName, uint64_t key);
+// Writes through a temporary file that replaces fileName on success, so readers never see partial files.
+// Returns false if the cache could not be written.
+bool writeCubemapCache(std::string_view fileName, uint64_t key, const CubemapData& data);
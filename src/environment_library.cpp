@@ -0,0 +1,147 @@
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+#include "environment_library.h"
+
+// Each load runs the IBL pipeline on all worker threads, so more than a couple at once only compete for them
+static constexpr int maxLoadsForPreload = 2;
+
+EnvironmentLibrary::EnvironmentLibrary(TextureUploader& uploader, size_t budgetBytes, IrradianceMode irradianceMode, BitmapFormat format)
+    : uploader(&uploader), budget(budgetBytes), irradianceMode(irradianceMode), format(format)
+{
+}
+
+int EnvironmentLibrary::add(std::string_view fileName)
+{
+    const auto it = std::find_if(entries.begin(), entries.end(), [&](const Entry& entry) { return entry.fileName == fileName; });
+    if (it != entries.end()) {
+        return static_cast<int>(it - entries.begin());
+    }
+    entries.push_back(Entry{ std::string(fileName) });
+    return getCount() - 1;
+}
+
+void EnvironmentLibrary::select(int index)
+{
+    selected = index;
+    entries[index].lastUsed = ++useCounter;
+    load(entries[index]);
+}
+
+void EnvironmentLibrary::preload(int index)
+{
+    if (!entries[index].cubemap && std::find(preloadQueue.begin(), preloadQueue.end(), index) == preloadQueue.end()) {
+        preloadQueue.push_back(index);
+    }
+}
+
+size_t EnvironmentLibrary::getTextureByteSize() const
+{
+    size_t size = 0;
+    for (const Entry& entry : entries) {
+        if (entry.cubemap) {
+            size += entry.cubemap->getTextureByteSize();
+        }
+    }
+    return size;
+}
+
+void EnvironmentLibrary::bind() const
+{
+    if (current >= 0) {
+        entries[current].cubemap->bind();
+    }
+}
+
+bool EnvironmentLibrary::update()
+{
+    bool rebind = false;
+    for (int index = 0; index < getCount(); index++) {
+        Entry& entry = entries[index];
+        if (!entry.cubemap) {
+            continue;
+        }
+        try {
+            if (entry.cubemap->update() && index == current) {
+                rebind = true;
+            }
+        }
+        catch (const std::exception& exception) {
+            std::cerr << "Could not load environment " << entry.fileName << ": " << exception.what() << std::endl;
+            // The bound environment keeps its placeholder or irradiance preview; any other one is dropped, and
+            // selecting it again retries the load
+            const bool isBound = index == current || (current < 0 && index == selected);
+            if (!isBound) {
+                entry.cubemap.reset();
+                if (index == selected) {
+                    selected = current;
+                }
+            }
+        }
+    }
+    // Until the first environment is loaded, its placeholder is bound
+    if (selected >= 0 && selected != current && (current < 0 || !entries[selected].cubemap->isLoading())) {
+        current = selected;
+        rebind = true;
+    }
+    evict();
+    startPreloads();
+    return rebind;
+}
+
+void EnvironmentLibrary::load(Entry& entry)
+{
+    if (!entry.cubemap) {
+        entry.cubemap = Cubemap::loadAsync(entry.fileName, *uploader, irradianceMode, format);
+    }
+}
+
+// Least recently used first. The current and selected environments are kept, and so are the ones with a worker
+// still running, since destroying them would wait for the worker: loading ones hold no more than a placeholder yet,
+// and refining ones are evicted once their irradiance is final.
+void EnvironmentLibrary::evict()
+{
+    size_t size = getTextureByteSize();
+    while (size > budget) {
+        Entry* oldest = nullptr;
+        for (int index = 0; index < getCount(); index++) {
+            Entry& entry = entries[index];
+            const bool isEvictable = entry.cubemap && index != current && index != selected
+                && !entry.cubemap->isLoading() && !entry.cubemap->isRefiningIrradiance();
+            if (isEvictable && (!oldest || entry.lastUsed < oldest->lastUsed)) {
+                oldest = &entry;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        size -= oldest->cubemap->getTextureByteSize();
+        oldest->cubemap.reset();
+    }
+}
+
+// Started while fewer than maxLoadsForPreload environments are loading. Preloads past the budget would only be
+// evicted again right after loading, so the rest of the queue is dropped once the resident environments fill it.
+void EnvironmentLibrary::startPreloads()
+{
+    int numLoading = 0;
+    for (const Entry& entry : entries) {
+        if (entry.cubemap && entry.cubemap->isLoading()) {
+            numLoading++;
+        }
+    }
+    while (!preloadQueue.empty() && numLoading < maxLoadsForPreload) {
+        if (getTextureByteSize() >= budget) {
+            preloadQueue.clear();
+            break;
+        }
+        Entry& entry = entries[preloadQueue.front()];
+        preloadQueue.pop_front();
+        if (!entry.cubemap) {
+            entry.lastUsed = ++useCounter;
+            load(entry);
+            numLoading++;
+        }
+    }
+}
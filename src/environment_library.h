@@ -0,0 +1,69 @@
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cubemap.h"
+
+// Environment maps to switch between, of which as many stay resident on the GPU as fit a texture memory budget.
+// Switching to a resident environment takes effect in the next update(); any other is loaded asynchronously while
+// the current one stays bound. When the budget is exceeded, the least recently selected environments are evicted;
+// loading them again reads the IBL cache instead of processing the map.
+class EnvironmentLibrary {
+public:
+    // Cubemaps are loaded with irradianceMode and format and uploaded through uploader, which has to outlive the library
+    EnvironmentLibrary(TextureUploader& uploader, size_t budgetBytes, IrradianceMode irradianceMode = IrradianceMode::MonteCarlo, BitmapFormat format = BitmapFormat::RGB16F);
+
+    // Returns the index of the environment map, which is added unless it already is part of the library
+    int add(std::string_view fileName);
+    int getCount() const { return static_cast<int>(entries.size()); }
+    const std::string& getFileName(int index) const { return entries[index].fileName; }
+    bool isResident(int index) const { return entries[index].cubemap.has_value(); }
+    bool isLoading(int index) const { return isResident(index) && entries[index].cubemap->isLoading(); }
+
+    // Makes index the environment that update() switches to once it is loaded
+    void select(int index);
+    int getSelected() const { return selected; }
+    // Queues an environment to load in the background, so that selecting it later switches right away. Queued
+    // environments are started by update() a few at a time, and the queue is dropped once the budget is used up.
+    void preload(int index);
+
+    // Bytes of texture data of all resident environments; may exceed the budget while environments are loading,
+    // or if the selected one alone does not fit
+    size_t getTextureByteSize() const;
+    size_t getBudget() const { return budget; }
+    void setBudget(size_t bytes) { budget = bytes; }
+
+    // Binds the current environment
+    void bind() const;
+    // Call once per frame on the GL thread. Updates all resident cubemaps, switches to the selected environment once
+    // it is loaded and evicts environments over the budget. Returns true when the current environment has to be bound again.
+    // Environments that fail to load are logged to stderr and dropped, and a failed selection falls back to the current one.
+    bool update();
+private:
+    struct Entry {
+        std::string fileName;
+        std::optional<Cubemap> cubemap;
+        // Value of useCounter when the environment was last selected or preloaded
+        uint64_t lastUsed = 0;
+    };
+
+    void load(Entry& entry);
+    void evict();
+    void startPreloads();
+
+    TextureUploader* uploader;
+    size_t budget;
+    IrradianceMode irradianceMode;
+    BitmapFormat format;
+    std::vector<Entry> entries;
+    // Indices of the environments preload() was called for that have not been started yet
+    std::deque<int> preloadQueue;
+    uint64_t useCounter = 0;
+    // Index of the bound environment and the one to switch to, or -1
+    int current = -1;
+    int selected = -1;
+};
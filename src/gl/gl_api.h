@@ -26,6 +26,7 @@
 	PFNGLCLEARNAMEDFRAMEBUFFERIVPROC							glClearNamedFramebufferiv;
 	PFNGLCLEARNAMEDFRAMEBUFFERUIVPROC						glClearNamedFramebufferuiv;
 	PFNGLCLEARSTENCILPROC										glClearStencil;
+	PFNGLCLIENTWAITSYNCPROC										glClientWaitSync;
 	PFNGLCOLORMASKPROC											glColorMask;
 	PFNGLCOMPILESHADERPROC										glCompileShader;
 	PFNGLCOMPRESSEDTEXIMAGE2DPROC								glCompressedTexImage2D;
@@ -53,7 +54,10 @@
 	PFNGLDELETEFRAMEBUFFERSPROC								glDeleteFramebuffers;
 	PFNGLDELETEPROGRAMPROC										glDeleteProgram;
 	PFNGLDELETEQUERIESPROC										glDeleteQueries;
+	PFNGLDELETERENDERBUFFERSPROC								glDeleteRenderbuffers;
+	PFNGLDELETESAMPLERSPROC										glDeleteSamplers;
 	PFNGLDELETESHADERPROC										glDeleteShader;
+	PFNGLDELETESYNCPROC											glDeleteSync;
 	PFNGLDELETETEXTURESPROC										glDeleteTextures;
 	PFNGLDELETEVERTEXARRAYSPROC								glDeleteVertexArrays;
 	PFNGLDEPTHFUNCPROC											glDepthFunc;
@@ -72,6 +76,7 @@
 	PFNGLENABLEVERTEXATTRIBARRAYPROC							glEnableVertexAttribArray;
 	PFNGLENABLEIPROC												glEnablei;
 	PFNGLENDQUERYPROC												glEndQuery;
+	PFNGLFENCESYNCPROC											glFenceSync;
 	PFNGLFINISHPROC												glFinish;
 	PFNGLFLUSHPROC													glFlush;
 	PFNGLFLUSHMAPPEDNAMEDBUFFERRANGEPROC					glFlushMappedNamedBufferRange;
@@ -93,6 +98,7 @@
 	PFNGLGETCOMPRESSEDTEXIMAGEPROC							glGetCompressedTexImage;
 	PFNGLGETCOMPRESSEDTEXTUREIMAGEPROC						glGetCompressedTextureImage;
 	PFNGLGETERRORPROC												glGetError;
+	PFNGLGETFLOATVPROC											glGetFloatv;
 	PFNGLGETINTEGERVPROC											glGetIntegerv;
 	PFNGLGETNAMEDBUFFERPARAMETERI64VPROC					glGetNamedBufferParameteri64v;
 	PFNGLGETNAMEDBUFFERPARAMETERIVPROC						glGetNamedBufferParameteriv;
@@ -122,6 +128,7 @@
 	PFNGLGETTEXTUREPARAMETERIUIVPROC							glGetTextureParameterIuiv;
 	PFNGLGETTEXTUREPARAMETERFVPROC							glGetTextureParameterfv;
 	PFNGLGETTEXTUREPARAMETERIVPROC							glGetTextureParameteriv;
+	PFNGLGETTEXTURESAMPLERHANDLEARBPROC							glGetTextureSamplerHandleARB;
 	PFNGLGETTRANSFORMFEEDBACKI64_VPROC						glGetTransformFeedbacki64_v;
 	PFNGLGETTRANSFORMFEEDBACKI_VPROC							glGetTransformFeedbacki_v;
 	PFNGLGETTRANSFORMFEEDBACKIVPROC							glGetTransformFeedbackiv;
@@ -134,8 +141,11 @@
 	PFNGLISPROGRAMPROC											glIsProgram;
 	PFNGLISSHADERPROC												glIsShader;
 	PFNGLLINKPROGRAMPROC											glLinkProgram;
+	PFNGLMAKETEXTUREHANDLENONRESIDENTARBPROC					glMakeTextureHandleNonResidentARB;
+	PFNGLMAKETEXTUREHANDLERESIDENTARBPROC						glMakeTextureHandleResidentARB;
 	PFNGLMAPNAMEDBUFFERPROC										glMapNamedBuffer;
 	PFNGLMAPNAMEDBUFFERRANGEPROC								glMapNamedBufferRange;
+	PFNGLMULTIDRAWELEMENTSINDIRECTPROC							glMultiDrawElementsIndirect;
 	PFNGLNAMEDBUFFERDATAPROC									glNamedBufferData;
 	PFNGLNAMEDBUFFERSTORAGEPROC								glNamedBufferStorage;
 	PFNGLNAMEDBUFFERSUBDATAPROC								glNamedBufferSubData;
@@ -163,6 +173,8 @@
 	PFNGLPROGRAMUNIFORM4IVPROC									glProgramUniform4iv;
 	PFNGLREADBUFFERPROC											glReadBuffer;
 	PFNGLREADPIXELSPROC											glReadPixels;
+	PFNGLSAMPLERPARAMETERFPROC									glSamplerParameterf;
+	PFNGLSAMPLERPARAMETERIPROC									glSamplerParameteri;
 	PFNGLSCISSORPROC												glScissor;
 	PFNGLSHADERSOURCEPROC										glShaderSource;
 	PFNGLTEXIMAGE2DPROC											glTexImage2D;
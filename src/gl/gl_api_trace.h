@@ -180,6 +180,13 @@ GLenum GLTracer_glGetError()
 	return r;
 }
 
+void GLTracer_glGetFloatv(GLenum pname, GLfloat* data)
+{
+	printf("glGetFloatv(" "%s, %p)\n", E2S(pname), data);
+	apiHook.glGetFloatv(pname, data);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
 void GLTracer_glGetIntegerv(GLenum pname, GLint* data)
 {
 	printf("glGetIntegerv(" "%s, %p)\n", E2S(pname), data);
@@ -643,6 +650,13 @@ void GLTracer_glBindFramebuffer(GLenum target, GLuint framebuffer)
 	assert(apiHook.glGetError() == GL_NO_ERROR);
 }
 
+void GLTracer_glDeleteRenderbuffers(GLsizei n, const GLuint* renderbuffers)
+{
+	printf("glDeleteRenderbuffers(" "%i, %p)\n", n, renderbuffers);
+	apiHook.glDeleteRenderbuffers(n, renderbuffers);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
 void GLTracer_glDeleteFramebuffers(GLsizei n, const GLuint* framebuffers)
 {
 	printf("glDeleteFramebuffers(" "%i, %p)\n", n, framebuffers);
@@ -735,6 +749,29 @@ void GLTracer_glUniformBlockBinding(GLuint program, GLuint uniformBlockIndex, GL
 	assert(apiHook.glGetError() == GL_NO_ERROR);
 }
 
+GLsync GLTracer_glFenceSync(GLenum condition, GLbitfield flags)
+{
+	printf("glFenceSync(" "%s, %u)\n", E2S(condition), (unsigned int)(flags));
+	GLsync const r = apiHook.glFenceSync(condition, flags);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+	return r;
+}
+
+void GLTracer_glDeleteSync(GLsync sync)
+{
+	printf("glDeleteSync(" "%p)\n", sync);
+	apiHook.glDeleteSync(sync);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
+GLenum GLTracer_glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+{
+	printf("glClientWaitSync(" "%p, %u, %" PRIu64 ")\n", sync, (unsigned int)(flags), timeout);
+	GLenum const r = apiHook.glClientWaitSync(sync, flags, timeout);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+	return r;
+}
+
 void GLTracer_glGetQueryObjectui64v(GLuint id, GLenum pname, GLuint64* params)
 {
 	printf("glGetQueryObjectui64v(" "%u, %s, %p)\n", id, E2S(pname), params);
@@ -870,6 +907,13 @@ void GLTracer_glProgramUniform4fv(GLuint program, GLint location, GLsizei count,
 	assert(apiHook.glGetError() == GL_NO_ERROR);
 }
 
+void GLTracer_glMultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride)
+{
+	printf("glMultiDrawElementsIndirect(" "%s, %s, %p, %i, %i)\n", E2S(mode), E2S(type), indirect, drawcount, stride);
+	apiHook.glMultiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
 void GLTracer_glBindTextures(GLuint first, GLsizei count, const GLuint* textures)
 {
 	printf("glBindTextures(" "%u, %i, %p)\n", first, count, textures);
@@ -1518,6 +1562,27 @@ void GLTracer_glCreateSamplers(GLsizei n, GLuint* samplers)
 	assert(apiHook.glGetError() == GL_NO_ERROR);
 }
 
+void GLTracer_glDeleteSamplers(GLsizei count, const GLuint* samplers)
+{
+	printf("glDeleteSamplers(" "%i, %p)\n", count, samplers);
+	apiHook.glDeleteSamplers(count, samplers);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
+void GLTracer_glSamplerParameteri(GLuint sampler, GLenum pname, GLint param)
+{
+	printf("glSamplerParameteri(" "%u, %s, %i)\n", sampler, E2S(pname), param);
+	apiHook.glSamplerParameteri(sampler, pname, param);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
+void GLTracer_glSamplerParameterf(GLuint sampler, GLenum pname, GLfloat param)
+{
+	printf("glSamplerParameterf(" "%u, %s, %f)\n", sampler, E2S(pname), param);
+	apiHook.glSamplerParameterf(sampler, pname, param);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
 void GLTracer_glCreateProgramPipelines(GLsizei n, GLuint* pipelines)
 {
 	printf("glCreateProgramPipelines(" "%i, %p)\n", n, pipelines);
@@ -1532,6 +1597,28 @@ void GLTracer_glCreateQueries(GLenum target, GLsizei n, GLuint* ids)
 	assert(apiHook.glGetError() == GL_NO_ERROR);
 }
 
+GLuint64 GLTracer_glGetTextureSamplerHandleARB(GLuint texture, GLuint sampler)
+{
+	printf("glGetTextureSamplerHandleARB(" "%u, %u)\n", texture, sampler);
+	GLuint64 const r = apiHook.glGetTextureSamplerHandleARB(texture, sampler);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+	return r;
+}
+
+void GLTracer_glMakeTextureHandleResidentARB(GLuint64 handle)
+{
+	printf("glMakeTextureHandleResidentARB(" "%" PRIu64 ")\n", handle);
+	apiHook.glMakeTextureHandleResidentARB(handle);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
+void GLTracer_glMakeTextureHandleNonResidentARB(GLuint64 handle)
+{
+	printf("glMakeTextureHandleNonResidentARB(" "%" PRIu64 ")\n", handle);
+	apiHook.glMakeTextureHandleNonResidentARB(handle);
+	assert(apiHook.glGetError() == GL_NO_ERROR);
+}
+
 #define INJECT(S) api->S = &GLTracer_##S;
 
 void InjectAPITracer4(GL4API* api)
@@ -1565,6 +1652,7 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glClearNamedFramebufferiv);
 	INJECT(glClearNamedFramebufferuiv);
 	INJECT(glClearStencil);
+	INJECT(glClientWaitSync);
 	INJECT(glColorMask);
 	INJECT(glCompileShader);
 	INJECT(glCompressedTexImage2D);
@@ -1592,7 +1680,10 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glDeleteFramebuffers);
 	INJECT(glDeleteProgram);
 	INJECT(glDeleteQueries);
+	INJECT(glDeleteRenderbuffers);
+	INJECT(glDeleteSamplers);
 	INJECT(glDeleteShader);
+	INJECT(glDeleteSync);
 	INJECT(glDeleteTextures);
 	INJECT(glDeleteVertexArrays);
 	INJECT(glDepthFunc);
@@ -1611,6 +1702,7 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glEnableVertexAttribArray);
 	INJECT(glEnablei);
 	INJECT(glEndQuery);
+	INJECT(glFenceSync);
 	INJECT(glFinish);
 	INJECT(glFlush);
 	INJECT(glFlushMappedNamedBufferRange);
@@ -1631,6 +1723,7 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glGetAttribLocation);
 	INJECT(glGetCompressedTexImage);
 	INJECT(glGetCompressedTextureImage);
+	INJECT(glGetFloatv);
 	INJECT(glGetIntegerv);
 	INJECT(glGetNamedBufferParameteri64v);
 	INJECT(glGetNamedBufferParameteriv);
@@ -1658,6 +1751,7 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glGetTextureParameterIuiv);
 	INJECT(glGetTextureParameterfv);
 	INJECT(glGetTextureParameteriv);
+	INJECT(glGetTextureSamplerHandleARB);
 	INJECT(glGetTransformFeedbacki64_v);
 	INJECT(glGetTransformFeedbacki_v);
 	INJECT(glGetTransformFeedbackiv);
@@ -1670,8 +1764,11 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glIsProgram);
 	INJECT(glIsShader);
 	INJECT(glLinkProgram);
+	INJECT(glMakeTextureHandleNonResidentARB);
+	INJECT(glMakeTextureHandleResidentARB);
 	INJECT(glMapNamedBuffer);
 	INJECT(glMapNamedBufferRange);
+	INJECT(glMultiDrawElementsIndirect);
 	INJECT(glNamedBufferData);
 	INJECT(glNamedBufferStorage);
 	INJECT(glNamedBufferSubData);
@@ -1699,6 +1796,8 @@ void InjectAPITracer4(GL4API* api)
 	INJECT(glProgramUniform4iv);
 	INJECT(glReadBuffer);
 	INJECT(glReadPixels);
+	INJECT(glSamplerParameterf);
+	INJECT(glSamplerParameteri);
 	INJECT(glScissor);
 	INJECT(glShaderSource);
 	INJECT(glTexImage2D);
@@ -1783,6 +1882,7 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glClearNamedFramebufferiv);
 	LOAD_GL_FUNC(glClearNamedFramebufferuiv);
 	LOAD_GL_FUNC(glClearStencil);
+	LOAD_GL_FUNC(glClientWaitSync);
 	LOAD_GL_FUNC(glColorMask);
 	LOAD_GL_FUNC(glCompileShader);
 	LOAD_GL_FUNC(glCompressedTexImage2D);
@@ -1810,7 +1910,10 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glDeleteFramebuffers);
 	LOAD_GL_FUNC(glDeleteProgram);
 	LOAD_GL_FUNC(glDeleteQueries);
+	LOAD_GL_FUNC(glDeleteRenderbuffers);
+	LOAD_GL_FUNC(glDeleteSamplers);
 	LOAD_GL_FUNC(glDeleteShader);
+	LOAD_GL_FUNC(glDeleteSync);
 	LOAD_GL_FUNC(glDeleteTextures);
 	LOAD_GL_FUNC(glDeleteVertexArrays);
 	LOAD_GL_FUNC(glDepthFunc);
@@ -1829,6 +1932,7 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glEnableVertexAttribArray);
 	LOAD_GL_FUNC(glEnablei);
 	LOAD_GL_FUNC(glEndQuery);
+	LOAD_GL_FUNC(glFenceSync);
 	LOAD_GL_FUNC(glFinish);
 	LOAD_GL_FUNC(glFlush);
 	LOAD_GL_FUNC(glFlushMappedNamedBufferRange);
@@ -1850,6 +1954,7 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glGetCompressedTexImage);
 	LOAD_GL_FUNC(glGetCompressedTextureImage);
 	LOAD_GL_FUNC(glGetError);
+	LOAD_GL_FUNC(glGetFloatv);
 	LOAD_GL_FUNC(glGetIntegerv);
 	LOAD_GL_FUNC(glGetNamedBufferParameteri64v);
 	LOAD_GL_FUNC(glGetNamedBufferParameteriv);
@@ -1877,6 +1982,7 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glGetTextureParameterIuiv);
 	LOAD_GL_FUNC(glGetTextureParameterfv);
 	LOAD_GL_FUNC(glGetTextureParameteriv);
+	LOAD_GL_FUNC(glGetTextureSamplerHandleARB);
 	LOAD_GL_FUNC(glGetTransformFeedbacki64_v);
 	LOAD_GL_FUNC(glGetTransformFeedbacki_v);
 	LOAD_GL_FUNC(glGetTransformFeedbackiv);
@@ -1889,8 +1995,11 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glIsProgram);
 	LOAD_GL_FUNC(glIsShader);
 	LOAD_GL_FUNC(glLinkProgram);
+	LOAD_GL_FUNC(glMakeTextureHandleNonResidentARB);
+	LOAD_GL_FUNC(glMakeTextureHandleResidentARB);
 	LOAD_GL_FUNC(glMapNamedBuffer);
 	LOAD_GL_FUNC(glMapNamedBufferRange);
+	LOAD_GL_FUNC(glMultiDrawElementsIndirect);
 	LOAD_GL_FUNC(glNamedBufferData);
 	LOAD_GL_FUNC(glNamedBufferStorage);
 	LOAD_GL_FUNC(glNamedBufferSubData);
@@ -1918,6 +2027,8 @@ void GetAPI4(GL4API* api, PFNGETGLPROC GetGLProc)
 	LOAD_GL_FUNC(glProgramUniform4iv);
 	LOAD_GL_FUNC(glReadBuffer);
 	LOAD_GL_FUNC(glReadPixels);
+	LOAD_GL_FUNC(glSamplerParameterf);
+	LOAD_GL_FUNC(glSamplerParameteri);
 	LOAD_GL_FUNC(glScissor);
 	LOAD_GL_FUNC(glShaderSource);
 	LOAD_GL_FUNC(glTexImage2D);
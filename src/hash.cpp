@@ -0,0 +1,20 @@
+#include "mapped_file.h"
+
+#include "hash.h"
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+uint64_t hashFile(std::string_view fileName, uint64_t seed)
+{
+    const MappedFile file(fileName);
+    return hashBytes(file.getData(), file.getSize(), seed);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// 64-bit FNV-1a; chain calls by passing the previous hash as seed
+constexpr uint64_t fnvOffsetBasis = 0xcbf29ce484222325ull;
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = fnvOffsetBasis);
+// Hashes the contents of a file through a memory mapping. Throws std::runtime_error if it cannot be opened.
+uint64_t hashFile(std::string_view fileName, uint64_t seed = fnvOffsetBasis);
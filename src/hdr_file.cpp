@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "hdr_file.h"
+
+static constexpr std::string_view signatures[] = { "#?RADIANCE\n", "#?RGBE\n" };
+
+static bool isRunLengthEncoded(int width)
+{
+    // Same limits as stb_image and the Radiance reference implementation
+    return width >= 8 && width < 32768;
+}
+
+HdrFile::HdrFile(MappedFile mappedFile) : file(std::move(mappedFile)), width(0), height(0), firstFlatScanline(0)
+{
+    if (!hasSignature(file)) {
+        throw std::runtime_error("Not a Radiance HDR file");
+    }
+    const uint8_t* data = file.getData();
+    const size_t size = file.getSize();
+    size_t pos = 0;
+    auto readLine = [&]() {
+        const size_t begin = pos;
+        while (pos < size && data[pos] != '\n') {
+            pos++;
+        }
+        if (pos == size) {
+            throw std::runtime_error("Invalid Radiance HDR file: truncated header");
+        }
+        return std::string(reinterpret_cast<const char*>(data + begin), pos++ - begin);
+    };
+
+    // Header lines up to an empty line, of which only the pixel format matters
+    bool isRgbe = false;
+    readLine();
+    for (std::string line = readLine(); !line.empty(); line = readLine()) {
+        if (line == "FORMAT=32-bit_rle_rgbe") {
+            isRgbe = true;
+        }
+    }
+    if (!isRgbe) {
+        throw std::runtime_error("Invalid Radiance HDR file: unsupported pixel format");
+    }
+    const std::string resolution = readLine();
+    if (std::sscanf(resolution.c_str(), "-Y %d +X %d", &height, &width) != 2 || width <= 0 || height <= 0) {
+        throw std::runtime_error("Invalid Radiance HDR file: unsupported orientation or size");
+    }
+
+    // Find the start of every scanline by walking the run lengths without decoding anything.
+    // Like stb_image, the first scanline without the RLE marker switches the rest of the file to flat pixels.
+    scanlineOffsets.resize(static_cast<size_t>(height) + 1);
+    firstFlatScanline = isRunLengthEncoded(width) ? height : 0;
+    for (int y = 0; y < height; y++) {
+        scanlineOffsets[y] = pos;
+        if (y < firstFlatScanline && pos + 4 <= size && data[pos] == 2 && data[pos + 1] == 2
+            && (data[pos + 2] & 0x80) == 0 && ((data[pos + 2] << 8) | data[pos + 3]) == width) {
+            pos += 4;
+            for (int channel = 0; channel < 4; channel++) {
+                for (int x = 0; x < width;) {
+                    if (pos >= size) {
+                        throw std::runtime_error("Invalid Radiance HDR file: truncated scanline");
+                    }
+                    int count = data[pos++];
+                    if (count > 128) {
+                        count -= 128;
+                        pos++;
+                    }
+                    else {
+                        pos += count;
+                    }
+                    x += count;
+                    if (count == 0 || x > width) {
+                        throw std::runtime_error("Invalid Radiance HDR file: bad run length");
+                    }
+                }
+            }
+        }
+        else {
+            firstFlatScanline = std::min(firstFlatScanline, y);
+            pos += static_cast<size_t>(width) * 4;
+        }
+        if (pos > size) {
+            throw std::runtime_error("Invalid Radiance HDR file: truncated scanline");
+        }
+    }
+    scanlineOffsets[height] = pos;
+}
+
+void HdrFile::decodeScanline(int y, std::span<uint8_t> rgbe) const
+{
+    const uint8_t* src = file.getData() + scanlineOffsets[y];
+    if (y >= firstFlatScanline) {
+        std::memcpy(rgbe.data(), src, static_cast<size_t>(width) * 4);
+        return;
+    }
+    // Skip the marker, then the four channels follow each other; the scan validated all run lengths
+    src += 4;
+    for (int channel = 0; channel < 4; channel++) {
+        for (int x = 0; x < width;) {
+            int count = *src++;
+            if (count > 128) {
+                count -= 128;
+                const uint8_t value = *src++;
+                for (int i = 0; i < count; i++) {
+                    rgbe[(x + i) * 4 + channel] = value;
+                }
+            }
+            else {
+                for (int i = 0; i < count; i++) {
+                    rgbe[(x + i) * 4 + channel] = *src++;
+                }
+            }
+            x += count;
+        }
+    }
+}
+
+bool HdrFile::hasSignature(const MappedFile& file)
+{
+    const std::string_view head(reinterpret_cast<const char*>(file.getData()), file.getSize());
+    for (std::string_view signature : signatures) {
+        if (head.starts_with(signature)) {
+            return true;
+        }
+    }
+    return false;
+}
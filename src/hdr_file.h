@@ -0,0 +1,30 @@
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+
+#include "mapped_file.h"
+
+// Reader for Radiance RGBE (.hdr) files. A quick scan over the run-length encoded data finds where
+// every scanline starts, after which scanlines can be decoded independently, e.g. in parallel.
+class HdrFile {
+public:
+    // Throws std::runtime_error if the file is not a valid Radiance file
+    explicit HdrFile(MappedFile file);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    // Decodes scanline y (top to bottom) into 4 * width bytes of RGBE pixels
+    void decodeScanline(int y, std::span<uint8_t> rgbe) const;
+
+    static bool hasSignature(const MappedFile& file);
+private:
+    MappedFile file;
+    int width;
+    int height;
+    // Offset of every scanline in the file, plus the end of the last one
+    std::vector<size_t> scanlineOffsets;
+    // Scanlines from this index on are stored flat, without run-length encoding
+    int firstFlatScanline;
+};
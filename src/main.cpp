@@ -2,6 +2,9 @@
 #include <chrono>
 #include <iostream>
 #include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
 
 #include "gl/gl.h"
 
@@ -17,19 +20,19 @@
 #include <stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
-#define STB_IMAGE_RESIZE_IMPLEMENTATION
-#include <stb_image_resize2.h>
 
 #include "imgui/imgui_impl_glfw.h"
 #include "imgui/imgui_impl_opengl3.h"
 
 #include "shader.h"
 #include "cubemap.h"
+#include "environment_library.h"
 #include "mesh.h"
 #include "camera.h"
 #include "fps.h"
 
 static void saveScreenshot(std::string_view fileName);
+static void benchmarkTextureFiltering(const GLProgram& program, GLuint perFrameDataBuf, TextureUploader& uploader, std::string_view meshFileName);
 
 struct PerFrameData {
     glm::mat4 model;
@@ -61,8 +64,12 @@ static struct RenderState {
     float scale[3] = { 1.0f, 1.0f, 1.0f };
 } renderState;
 
-int main()
+// With --benchmark, the window stays hidden and the GPU time of the mesh pass is measured for every texture
+// filtering mode instead of running the viewer, see benchmarkTextureFiltering()
+int main(int argc, char** argv)
 {
+    const bool benchmark = argc > 1 && std::string(argv[1]) == "--benchmark";
+
     glfwSetErrorCallback(
         [](int error, const char* description) {
             fprintf(stderr, "GLFW Error: %s\n", description);
@@ -76,6 +83,7 @@ int main()
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, benchmark ? GLFW_FALSE : GLFW_TRUE);
     window = glfwCreateWindow(1024, 768, "meshview", nullptr, nullptr);
     if (!window) {
         throw std::runtime_error("Could not create GLFW window");
@@ -124,6 +132,11 @@ int main()
     glfwMakeContextCurrent(window);
     glfwSwapInterval(1);
 
+    // Mesh materials reference their textures by bindless handles; without them the first mesh load would call null entry points
+    if (!glfwExtensionSupported("GL_ARB_bindless_texture")) {
+        throw std::runtime_error("GL_ARB_bindless_texture is not supported by the OpenGL driver");
+    }
+
     ImGui::CreateContext();
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 460 core");
@@ -131,7 +144,10 @@ int main()
     GetAPI4(&api, [](const char* func) -> void* {
         return (void*)glfwGetProcAddress(func);
     });
-    InjectAPITracer4(&api);
+    // The tracer checks for errors after every call, which would stall the GPU timings
+    if (!benchmark) {
+        InjectAPITracer4(&api);
+    }
 
     api.glEnable(GL_DEPTH_TEST);
     api.glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
@@ -147,10 +163,27 @@ int main()
         GLShader cubemapFragment("data/cubemap.frag");
         GLProgram cubemapProgram(cubemapVertex, cubemapFragment);
 
-        Cubemap cubemap("data/piazza_bologni_1k.hdr");
-        cubemap.bind();
+        // Staging memory for all texture uploads; declared first, so it outlives everything uploading through it
+        TextureUploader uploader(size_t(64) << 20);
+
+        // Every Radiance map in data/ can be selected in the UI; up to 256 MiB of them stay on the GPU
+        EnvironmentLibrary environments(uploader, size_t(256) << 20, IrradianceMode::MonteCarlo, BitmapFormat::BC6H);
+        environments.select(environments.add("data/piazza_bologni_1k.hdr"));
+        std::vector<std::string> environmentFileNames;
+        for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator("data")) {
+            if (entry.path().extension() == ".hdr") {
+                environmentFileNames.push_back(entry.path().generic_string());
+            }
+        }
+        std::sort(environmentFileNames.begin(), environmentFileNames.end());
+        for (const std::string& fileName : environmentFileNames) {
+            environments.add(fileName);
+        }
+        environments.update();
+        environments.bind();
 
-        Mesh mesh("data/DamagedHelmet/DamagedHelmet.gltf");
+        const std::string meshFileName = "data/DamagedHelmet/DamagedHelmet.gltf";
+        Mesh mesh(meshFileName, uploader);
         mesh.bind();
 
         GLuint brdfLutHandle;
@@ -165,7 +198,6 @@ int main()
             while ((width | height) >> numMipmaps) {
                 numMipmaps += 1;
             }
-            api.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
             api.glCreateTextures(GL_TEXTURE_2D, 1, &brdfLutHandle);
             api.glTextureParameteri(brdfLutHandle, GL_TEXTURE_MAX_LEVEL, 0);
             api.glTextureParameteri(brdfLutHandle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -173,7 +205,13 @@ int main()
             api.glTextureParameteri(brdfLutHandle, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
             api.glTextureParameteri(brdfLutHandle, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
             api.glTextureStorage2D(brdfLutHandle, numMipmaps, format.Internal, width, height);
-            api.glTextureSubImage2D(brdfLutHandle, 0, 0, 0, width, height, format.External, format.Type, tex.data(0, 0, 0));
+            TextureRegion region;
+            region.handle = brdfLutHandle;
+            region.width = width;
+            region.height = height;
+            region.format = format.External;
+            region.type = format.Type;
+            uploader.upload(region, tex.data(0, 0, 0), tex.size(0));
         }
         api.glBindTextureUnit(7, brdfLutHandle);
 
@@ -182,6 +220,21 @@ int main()
         api.glNamedBufferStorage(perFrameDataBuf, sizeof(PerFrameData), nullptr, GL_DYNAMIC_STORAGE_BIT);
         api.glBindBufferRange(GL_UNIFORM_BUFFER, 0, perFrameDataBuf, 0, sizeof(PerFrameData));
 
+        if (benchmark) {
+            // Lit by the real environment, not the placeholder
+            do {
+                if (environments.update()) {
+                    environments.bind();
+                }
+                uploader.update();
+                // The environment loads on worker threads; poll without taking a core from them
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            } while (environments.isLoading(environments.getSelected()));
+            benchmarkTextureFiltering(modelProgram, perFrameDataBuf, uploader, meshFileName);
+            mesh.bind();
+            glfwSetWindowShouldClose(window, GLFW_TRUE);
+        }
+
         double timestamp = glfwGetTime();
         float deltaSeconds = 0.0f;
         FramesPerSecondCounter fpsCounter(0.5f);        
@@ -197,6 +250,11 @@ int main()
 
             glfwPollEvents();
 
+            if (environments.update()) {
+                environments.bind();
+            }
+            uploader.update();
+
             if (!ImGui::GetIO().WantCaptureMouse) {
                 positioner.update(deltaSeconds, mouseState.pos, mouseState.pressedLeft);
             }
@@ -287,6 +345,25 @@ int main()
                 ImGui::SliderFloat3("Rotation", renderState.rotation, -180.0f, 180.0f, "%.1f");
                 ImGui::SliderFloat3("Scale", renderState.scale, 0.0f, 10.0f, "%.1f");
             }
+            ImGui::Separator();
+            const int selectedEnvironment = environments.getSelected();
+            if (ImGui::BeginCombo("Environment", environments.getFileName(selectedEnvironment).c_str())) {
+                for (int i = 0; i < environments.getCount(); i++) {
+                    // Resident environments switch without loading
+                    const std::string label = environments.getFileName(i) + (environments.isResident(i) ? " *" : "");
+                    if (ImGui::Selectable(label.c_str(), i == selectedEnvironment)) {
+                        environments.select(i);
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            if (ImGui::Button("Preload all")) {
+                for (int i = 0; i < environments.getCount(); i++) {
+                    environments.preload(i);
+                }
+            }
+            ImGui::Text("Environments: %.1f / %.1f MiB%s", environments.getTextureByteSize() / 1048576.0,
+                environments.getBudget() / 1048576.0, environments.isLoading(selectedEnvironment) ? ", loading" : "");
             ImGui::End();
 
             ImGui::Render();
@@ -318,3 +395,77 @@ static void saveScreenshot(std::string_view fileName)
     stbi_flip_vertically_on_write(1);
     stbi_write_png(fileNameString.c_str(), width, height, 4, data.data(), 0);
 }
+
+// Renders the mesh into an offscreen 1920x1080 target from several distances and prints the average GPU time of
+// the draw for each TextureFiltering mode. The farther the camera, the more the textures are minified, so without
+// mips every fragment reads texels far apart from its neighbours'.
+static void benchmarkTextureFiltering(const GLProgram& program, GLuint perFrameDataBuf, TextureUploader& uploader, std::string_view meshFileName)
+{
+    constexpr int width = 1920;
+    constexpr int height = 1080;
+    constexpr int numFrames = 100;
+    constexpr float distances[] = { 1.5f, 3.0f, 6.0f, 12.0f, 24.0f, 48.0f };
+
+    GLuint renderbuffers[2];
+    api.glCreateRenderbuffers(2, renderbuffers);
+    api.glNamedRenderbufferStorage(renderbuffers[0], GL_RGBA8, width, height);
+    api.glNamedRenderbufferStorage(renderbuffers[1], GL_DEPTH_COMPONENT24, width, height);
+    GLuint framebuffer;
+    api.glCreateFramebuffers(1, &framebuffer);
+    api.glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    api.glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (api.glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("Could not create the benchmark framebuffer");
+    }
+    api.glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    api.glViewport(0, 0, width, height);
+    GLuint query;
+    api.glCreateQueries(GL_TIME_ELAPSED, 1, &query);
+
+    printf("Mesh pass GPU time in ms, %dx%d, average of %d frames\n", width, height, numFrames);
+    printf("%-12s", "distance");
+    for (float distance : distances) {
+        printf("%9.1f", distance);
+    }
+    printf("\n");
+    program.useProgram();
+    api.glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    for (TextureFiltering filtering : { TextureFiltering::Bilinear, TextureFiltering::Trilinear, TextureFiltering::Anisotropic }) {
+        const Mesh mesh(meshFileName, uploader, filtering);
+        mesh.bind();
+        uploader.update();
+        printf("%-12s", filtering == TextureFiltering::Bilinear ? "bilinear" : filtering == TextureFiltering::Trilinear ? "trilinear" : "anisotropic");
+        for (float distance : distances) {
+            // Looking down at an angle, so that some surfaces are seen at grazing angles
+            const glm::vec3 eye = glm::normalize(glm::vec3(0.0f, 0.5f, 1.0f)) * distance;
+            const PerFrameData perFrameData = {
+                .model = glm::mat4(1.0f),
+                .view = glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)),
+                .proj = glm::perspective(glm::radians(45.0f), float(width) / float(height), 0.1f, 1000.0f),
+                .cameraPos = glm::vec4(eye, 1.0f),
+                .isWireframe = false
+            };
+            api.glNamedBufferSubData(perFrameDataBuf, 0, sizeof(PerFrameData), &perFrameData);
+            GLuint64 totalNanoseconds = 0;
+            // One frame more than measured, the first one warms up caches and finishes the texture uploads
+            for (int frame = 0; frame <= numFrames; frame++) {
+                api.glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                api.glBeginQuery(GL_TIME_ELAPSED, query);
+                mesh.draw();
+                api.glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 nanoseconds = 0;
+                api.glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+                if (frame > 0) {
+                    totalNanoseconds += nanoseconds;
+                }
+            }
+            printf("%9.3f", totalNanoseconds / 1e6 / numFrames);
+        }
+        printf("\n");
+    }
+
+    api.glDeleteQueries(1, &query);
+    api.glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    api.glDeleteFramebuffers(1, &framebuffer);
+    api.glDeleteRenderbuffers(2, renderbuffers);
+}
@@ -0,0 +1,119 @@
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <filesystem>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+MappedFile::MappedFile(std::string_view fileName) : MappedFile()
+{
+    const std::string fileNameString(fileName);
+#ifdef _WIN32
+    HANDLE file = CreateFileW(std::filesystem::path(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("Could not open file: " + fileNameString);
+    }
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        unmap();
+        throw std::runtime_error("Could not get file size: " + fileNameString);
+    }
+    size = static_cast<size_t>(fileSize.QuadPart);
+    // Empty files cannot be mapped, they are represented by a null pointer and size 0
+    if (size == 0) {
+        return;
+    }
+    mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mappingHandle) {
+        unmap();
+        throw std::runtime_error("Could not map file: " + fileNameString);
+    }
+    data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+    const int file = open(fileNameString.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw std::runtime_error("Could not open file: " + fileNameString);
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0) {
+        close(file);
+        throw std::runtime_error("Could not get file size: " + fileNameString);
+    }
+    size = static_cast<size_t>(fileStat.st_size);
+    if (size == 0) {
+        close(file);
+        return;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping keeps its own reference to the file
+    close(file);
+    data = mapping != MAP_FAILED ? static_cast<const uint8_t*>(mapping) : nullptr;
+#endif
+    if (!data) {
+        unmap();
+        throw std::runtime_error("Could not map file: " + fileNameString);
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : data(other.data)
+    , size(other.size)
+    , fileHandle(other.fileHandle)
+    , mappingHandle(other.mappingHandle)
+{
+    other.data = nullptr;
+    other.size = 0;
+    other.fileHandle = nullptr;
+    other.mappingHandle = nullptr;
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        data = std::exchange(other.data, nullptr);
+        size = std::exchange(other.size, 0);
+        fileHandle = std::exchange(other.fileHandle, nullptr);
+        mappingHandle = std::exchange(other.mappingHandle, nullptr);
+    }
+    return *this;
+}
+
+void MappedFile::unmap()
+{
+#ifdef _WIN32
+    if (data) {
+        UnmapViewOfFile(data);
+    }
+    if (mappingHandle) {
+        CloseHandle(mappingHandle);
+    }
+    if (fileHandle) {
+        CloseHandle(fileHandle);
+    }
+#else
+    if (data) {
+        munmap(const_cast<uint8_t*>(data), size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Read-only memory mapping of a whole file. Pages are loaded on first access and shared with the
+// OS page cache, so repeated launches read cached files without any I/O.
+class MappedFile {
+public:
+    MappedFile() : data(nullptr), size(0), fileHandle(nullptr), mappingHandle(nullptr) {}
+    // Throws std::runtime_error if the file cannot be opened or mapped
+    explicit MappedFile(std::string_view fileName);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    const uint8_t* getData() const { return data; }
+    size_t getSize() const { return size; }
+private:
+    void unmap();
+
+    const uint8_t* data;
+    size_t size;
+    // Native handles, only used on Windows
+    void* fileHandle;
+    void* mappingHandle;
+};
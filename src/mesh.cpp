@@ -1,102 +1,83 @@
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <stdexcept>
 
 #include <glm/glm.hpp>
+#include <glm/ext.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
+#include <assimp/cfileio.h>
 #include <assimp/version.h>
-#include <stb_image.h>
 
 #include "gl/gl.h"
+#include "bitmap.h"
+#include "hash.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "texture_cache.h"
+#include "texture_upload.h"
 
 #include "mesh.h"
 
-static void loadTexture(std::string_view filePath, GLuint* handle);
+static void uploadTexture(TextureUploader& uploader, const TextureData& data, GLuint* handle);
+static void createDefaultTexture(TextureUploader& uploader, const uint8_t* texel, GLuint* handle);
+static glm::mat4 toMat4(const aiMatrix4x4& matrix);
+static MeshData importMesh(std::string_view fileName);
+static aiFile* openImportFile(aiFileIO* fileIO, const char* fileName, const char* mode);
+static void closeImportFile(aiFileIO* fileIO, aiFile* file);
 
-Mesh::Mesh(std::string_view fileName)
-{
-    const std::string fileNameString(fileName);
-    const aiScene* scene = aiImportFile(fileNameString.c_str(), aiProcessPreset_TargetRealtime_Quality);
-    if (!scene || !scene->HasMeshes() || !scene->HasMaterials()) {
-        throw std::runtime_error("Unable to load mesh: " + fileNameString);
-    }
-    
-    const aiMesh* mesh = scene->mMeshes[0];
-    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        const aiFace& face = mesh->mFaces[i];
-        for (unsigned int j = 0; j < face.mNumIndices; j++) {
-            indices.push_back(face.mIndices[j]);
-        }
-    }
-    for (int i = 0; i < mesh->mNumVertices; i++) {
-        const aiVector3D pos = mesh->mVertices[i];
-        const aiVector3D normal = mesh->mNormals[i];
-        const aiVector3D uv = mesh->mTextureCoords[0][i];
-        vertices.push_back({
-            .pos = glm::vec3(pos.x, pos.y, pos.z),
-            .normal = glm::vec3(normal.x, normal.y, normal.z),
-            .uv = glm::vec2(uv.x, -uv.y)
-        });
-    }
-
-    std::filesystem::path path(fileName);
-    std::string dataPath = path.parent_path().string() + "/";
-    aiMaterial* material = scene->mMaterials[0];
-    
-    aiString albedoFileName;
-    if (material->GetTexture(aiTextureType_BASE_COLOR, 0, &albedoFileName) != AI_SUCCESS) {
-        throw std::runtime_error("Missing BASE_COLOR (albedo) texture");
-    }
-    std::string albedoPath = dataPath + albedoFileName.C_Str();
-
-    aiString metallicRoughnessFileName;
-    if (material->GetTexture(aiTextureType_METALNESS, 0, &metallicRoughnessFileName) != AI_SUCCESS) {
-        throw std::runtime_error("Missing METALNESS (metallic roughness) texture");
-    }
-    std::string metallicRoughnessPath = dataPath + metallicRoughnessFileName.C_Str();
-
-    aiString ambientOcclusionFileName;
-    if (material->GetTexture(aiTextureType_LIGHTMAP, 0, &ambientOcclusionFileName) != AI_SUCCESS) {
-        throw std::runtime_error("Missing LIGHTMAP (ambient occlusion) texture");
-    }
-    std::string ambientOcclusionPath = dataPath + ambientOcclusionFileName.C_Str();
-
-    aiString emissiveFileName;
-    if (material->GetTexture(aiTextureType_EMISSIVE, 0, &emissiveFileName) != AI_SUCCESS) {
-        throw std::runtime_error("Missing EMISSIVE (emissive) texture");
-    }
-    std::string emissivePath = dataPath + emissiveFileName.C_Str();
+// Bump whenever importMesh() changes what it produces
+static constexpr uint32_t meshCacheVersion = 1;
+static constexpr uint32_t importFlags = aiProcessPreset_TargetRealtime_Quality;
 
-    aiString normalsFileName;
-    if (material->GetTexture(aiTextureType_NORMALS, 0, &normalsFileName) != AI_SUCCESS) {
-        throw std::runtime_error("Missing NORMALS (normals) texture");
-    }
-    std::string normalsPath = dataPath + normalsFileName.C_Str();
+// Highest anisotropy requested for TextureFiltering::Anisotropic
+static constexpr float maxTextureAnisotropy = 16.0f;
 
-    aiReleaseImport(scene);
+// Texture slots of MaterialData, how their files are encoded, and the texel of the 1x1 texture used in place of a missing texture
+static constexpr aiTextureType materialTextureTypes[materialTextureCount] = {
+    aiTextureType_BASE_COLOR,
+    aiTextureType_METALNESS,
+    aiTextureType_LIGHTMAP,
+    aiTextureType_EMISSIVE,
+    aiTextureType_NORMALS
+};
+static constexpr TextureEncoding materialTextureEncodings[materialTextureCount] = {
+    TextureEncoding::ColorSRGB,
+    TextureEncoding::MetallicRoughness,
+    TextureEncoding::Occlusion,
+    TextureEncoding::ColorSRGB,
+    TextureEncoding::Normals
+};
+static constexpr uint8_t defaultTexels[materialTextureCount][4] = {
+    { 255, 255, 255, 255 },
+    { 255, 255, 255, 255 },
+    { 255, 255, 255, 255 },
+    { 255, 255, 255, 255 },
+    { 128, 128, 255, 255 }
+};
 
-    // Center mesh at (0, 0, 0)
-    glm::vec3 boundsMin = glm::vec3(0.0f);
-    glm::vec3 boundsMax = glm::vec3(0.0f);
-    for (const VertexData& data : vertices) {
-        boundsMin.x = std::fmin(boundsMin.x, data.pos.x);
-        boundsMin.y = std::fmin(boundsMin.y, data.pos.y);
-        boundsMin.z = std::fmin(boundsMin.z, data.pos.z);
+Mesh::Mesh(std::string_view fileName, TextureUploader& uploader, TextureFiltering filtering)
+{
+    const MeshData data = loadData(fileName);
 
-        boundsMax.x = std::fmax(boundsMax.x, data.pos.x);
-        boundsMax.y = std::fmax(boundsMax.y, data.pos.y);
-        boundsMax.z = std::fmax(boundsMax.z, data.pos.z);
-    }
-    glm::vec3 centerOffset = (boundsMin + boundsMax) / 2.0f;
-    for (VertexData& data : vertices) {
-        data.pos += centerOffset;
-    }
+    // Full mip chains, Kaiser-filtered on the CPU so minified textures neither alias nor blur like a box filter,
+    // and block-compressed to a quarter (BC7, BC5) or an eighth (BC4) of RGBA8. Baked textures are cached, so
+    // later loads only map the cache files. The files are processed on worker threads, only the uploads below
+    // happen on this one.
+    const std::vector<TextureData> textureData = loadTextureData(data.textureFiles);
 
     api.glCreateVertexArrays(1, &vao);
     
     api.glCreateBuffers(1, &vertexData);
-    api.glNamedBufferStorage(vertexData, sizeof(VertexData) * vertices.size(), vertices.data(), 0);
+    api.glNamedBufferStorage(vertexData, data.vertices.size_bytes(), data.vertices.data(), 0);
     api.glVertexArrayVertexBuffer(vao, 0, vertexData, 0, sizeof(VertexData));
     // pos
     api.glEnableVertexArrayAttrib(vao, 0);
@@ -112,23 +93,99 @@ Mesh::Mesh(std::string_view fileName)
     api.glVertexArrayAttribBinding(vao, 2, 0);
 
     api.glCreateBuffers(1, &indexData);
-    api.glNamedBufferStorage(indexData, sizeof(unsigned int) * indices.size(), indices.data(), 0);
+    api.glNamedBufferStorage(indexData, data.indices.size_bytes(), data.indices.data(), 0);
     api.glVertexArrayElementBuffer(vao, indexData);
 
-    loadTexture(albedoPath.c_str(), &textureAlbedo);
-    loadTexture(metallicRoughnessPath.c_str(), &textureMetallicRougness);
-    loadTexture(ambientOcclusionPath.c_str(), &textureAmbientOcclusion);
-    loadTexture(emissivePath.c_str(), &textureEmissive);
-    loadTexture(normalsPath.c_str(), &textureNormals);
+    drawCount = static_cast<GLsizei>(data.commands.size());
+    api.glCreateBuffers(1, &commandData);
+    api.glNamedBufferStorage(commandData, data.commands.size_bytes(), data.commands.data(), 0);
+    api.glCreateBuffers(1, &drawData);
+    api.glNamedBufferStorage(drawData, data.draws.size_bytes(), data.draws.data(), 0);
+
+    // The default textures come first, followed by the texture files
+    for (int slot = 0; slot < materialTextureCount; slot++) {
+        textures.push_back(0);
+        createDefaultTexture(uploader, defaultTexels[slot], &textures.back());
+    }
+    for (const TextureData& texture : textureData) {
+        textures.push_back(0);
+        uploadTexture(uploader, texture, &textures.back());
+    }
+
+    // The sampler object overrides the sampling state of the textures for their bindless handles
+    api.glCreateSamplers(1, &sampler);
+    api.glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, filtering == TextureFiltering::Bilinear ? GL_LINEAR : GL_LINEAR_MIPMAP_LINEAR);
+    api.glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    api.glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    api.glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    if (filtering == TextureFiltering::Anisotropic) {
+        GLfloat maxAnisotropy = 1.0f;
+        api.glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maxAnisotropy);
+        api.glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY, std::min(maxAnisotropy, maxTextureAnisotropy));
+    }
+    for (GLuint texture : textures) {
+        textureHandles.push_back(api.glGetTextureSamplerHandleARB(texture, sampler));
+        api.glMakeTextureHandleResidentARB(textureHandles.back());
+    }
+    std::vector<MaterialData> materials(data.materials.begin(), data.materials.end());
+    for (size_t materialIndex = 0; materialIndex < materials.size(); materialIndex++) {
+        for (int slot = 0; slot < materialTextureCount; slot++) {
+            const int textureIndex = data.materialTextures[materialIndex][slot];
+            materials[materialIndex].textures[slot] = textureHandles[textureIndex < 0 ? slot : materialTextureCount + textureIndex];
+        }
+    }
+    api.glCreateBuffers(1, &materialData);
+    api.glNamedBufferStorage(materialData, sizeof(MaterialData) * materials.size(), materials.data(), 0);
+}
+
+MeshData Mesh::loadData(std::string_view fileName)
+{
+    // Everything besides the file contents that affects the imported data
+    const uint32_t parameters[] = {
+        meshCacheVersion,
+        importFlags,
+        aiGetVersionMajor(),
+        aiGetVersionMinor(),
+        aiGetVersionRevision()
+    };
+    const uint64_t key = hashBytes(parameters, sizeof(parameters), hashFile(fileName));
+    // The hash of the path tells apart scenes of the same name, which would otherwise replace each other's entry
+    const std::string path = std::filesystem::absolute(fileName).lexically_normal().string();
+    char hashString[10];
+    std::snprintf(hashString, sizeof(hashString), "%08llx", static_cast<unsigned long long>(hashBytes(path.data(), path.size()) & 0xffffffffull));
+    const std::string cacheFileName = std::filesystem::path(fileName).stem().string() + "-" + hashString + ".meshcache";
+    if (std::optional<MeshData> cached = readMeshCache(cacheFileName, key)) {
+        // The key only covers the scene file itself; the files it references have to be unchanged as well
+        const bool isCurrent = std::all_of(cached->sourceFiles.begin(), cached->sourceFiles.end(), [](const auto& sourceFile) {
+            try {
+                return hashFile(sourceFile.first) == sourceFile.second;
+            }
+            catch (const std::runtime_error&) {
+                return false;
+            }
+        });
+        if (isCurrent) {
+            return std::move(*cached);
+        }
+    }
+    MeshData data = importMesh(fileName);
+    // Without a cache the next start simply imports the scene again
+    writeMeshCache(cacheFileName, key, data);
+    return data;
 }
 
 Mesh::~Mesh()
 {
-    api.glDeleteTextures(1, &textureNormals);
-    api.glDeleteTextures(1, &textureEmissive);
-    api.glDeleteTextures(1, &textureAmbientOcclusion);
-    api.glDeleteTextures(1, &textureMetallicRougness);
-    api.glDeleteTextures(1, &textureAlbedo);
+    for (GLuint64 handle : textureHandles) {
+        api.glMakeTextureHandleNonResidentARB(handle);
+    }
+    if (!textures.empty()) {
+        api.glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+    }
+    api.glDeleteSamplers(1, &sampler);
+    api.glDeleteBuffers(1, &materialData);
+    api.glDeleteBuffers(1, &drawData);
+    api.glDeleteBuffers(1, &commandData);
     api.glDeleteBuffers(1, &indexData);
     api.glDeleteBuffers(1, &vertexData);
     api.glDeleteVertexArrays(1, &vao);    
@@ -138,22 +195,24 @@ Mesh::Mesh(Mesh&& other) noexcept
     : vao(other.vao)
     , vertexData(other.vertexData)
     , indexData(other.indexData)
-    , textureAlbedo(other.textureAlbedo)
-    , textureMetallicRougness(other.textureMetallicRougness)
-    , textureAmbientOcclusion(other.textureAmbientOcclusion)
-    , textureEmissive(other.textureEmissive)
-    , textureNormals(other.textureNormals)
-    , indices(std::move(other.indices))
-    , vertices(std::move(other.vertices))
+    , commandData(other.commandData)
+    , drawData(other.drawData)
+    , materialData(other.materialData)
+    , sampler(other.sampler)
+    , drawCount(other.drawCount)
+    , textures(std::move(other.textures))
+    , textureHandles(std::move(other.textureHandles))
 {
     other.vao = 0;
     other.vertexData = 0;
     other.indexData = 0;
-    other.textureAlbedo = 0;
-    other.textureMetallicRougness = 0;
-    other.textureAmbientOcclusion = 0;
-    other.textureEmissive = 0;
-    other.textureNormals = 0;
+    other.commandData = 0;
+    other.drawData = 0;
+    other.materialData = 0;
+    other.sampler = 0;
+    other.drawCount = 0;
+    other.textures.clear();
+    other.textureHandles.clear();
 }
 
 Mesh& Mesh::operator=(Mesh&& other) noexcept
@@ -168,20 +227,23 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
         if (indexData) {
             api.glDeleteBuffers(1, &indexData);
         }
-        if (textureAlbedo) {
-            api.glDeleteTextures(1, &textureAlbedo);
+        if (commandData) {
+            api.glDeleteBuffers(1, &commandData);
         }
-        if (textureMetallicRougness) {
-            api.glDeleteTextures(1, &textureMetallicRougness);
+        if (drawData) {
+            api.glDeleteBuffers(1, &drawData);
         }
-        if (textureAmbientOcclusion) {
-            api.glDeleteTextures(1, &textureAmbientOcclusion);
+        if (materialData) {
+            api.glDeleteBuffers(1, &materialData);
         }
-        if (textureEmissive) {
-            api.glDeleteTextures(1, &textureEmissive);
+        for (GLuint64 handle : textureHandles) {
+            api.glMakeTextureHandleNonResidentARB(handle);
         }
-        if (textureNormals) {
-            api.glDeleteTextures(1, &textureNormals);
+        if (!textures.empty()) {
+            api.glDeleteTextures(static_cast<GLsizei>(textures.size()), textures.data());
+        }
+        if (sampler) {
+            api.glDeleteSamplers(1, &sampler);
         }
 
         vao = other.vao;
@@ -190,19 +252,20 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
         other.vertexData = 0;
         indexData = other.indexData;
         other.indexData = 0;
-        textureAlbedo = other.textureAlbedo;
-        other.textureAlbedo = 0;
-        textureMetallicRougness = other.textureMetallicRougness;
-        other.textureMetallicRougness = 0;
-        textureAmbientOcclusion = other.textureAmbientOcclusion;
-        other.textureAmbientOcclusion = 0;
-        textureEmissive = other.textureEmissive;
-        other.textureEmissive = 0;
-        textureNormals = other.textureNormals;
-        other.textureNormals = 0;
-
-        indices = std::move(other.indices);
-        vertices = std::move(other.vertices);
+        commandData = other.commandData;
+        other.commandData = 0;
+        drawData = other.drawData;
+        other.drawData = 0;
+        materialData = other.materialData;
+        other.materialData = 0;
+        sampler = other.sampler;
+        other.sampler = 0;
+        drawCount = other.drawCount;
+        other.drawCount = 0;
+        textures = std::move(other.textures);
+        other.textures.clear();
+        textureHandles = std::move(other.textureHandles);
+        other.textureHandles.clear();
     }
     return *this;
 }
@@ -210,28 +273,294 @@ Mesh& Mesh::operator=(Mesh&& other) noexcept
 void Mesh::bind() const
 {
     api.glBindVertexArray(vao);
-    api.glBindTextures(0, 1, &textureAlbedo);
-    api.glBindTextures(1, 1, &textureMetallicRougness);
-    api.glBindTextures(2, 1, &textureAmbientOcclusion);
-    api.glBindTextures(3, 1, &textureEmissive);
-    api.glBindTextures(4, 1, &textureNormals);
+    api.glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandData);
+    api.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, drawData);
+    api.glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, materialData);
 }
 
 void Mesh::draw() const
 {
-    api.glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, nullptr);
+    api.glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, drawCount, 0);
+}
+
+static GLenum getInternalFormat(TextureEncoding encoding)
+{
+    switch (encoding) {
+    case TextureEncoding::ColorSRGB:
+        return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+    case TextureEncoding::MetallicRoughness:
+    case TextureEncoding::Normals:
+        return GL_COMPRESSED_RG_RGTC2;
+    case TextureEncoding::Occlusion:
+        return GL_COMPRESSED_RED_RGTC1;
+    default:
+        throw std::invalid_argument("invalid texture encoding");
+    }
+}
+
+static void uploadTexture(TextureUploader& uploader, const TextureData& data, GLuint* handle)
+{
+    const GLenum internalFormat = getInternalFormat(data.encoding);
+    api.glCreateTextures(GL_TEXTURE_2D, 1, handle);
+    api.glTextureStorage2D(*handle, static_cast<GLsizei>(data.levels.size()), internalFormat, data.levels[0].width, data.levels[0].height);
+    if (data.encoding == TextureEncoding::MetallicRoughness) {
+        // Roughness and metallic back in green and blue, where the shader reads them
+        const GLint swizzle[4] = { GL_ONE, GL_RED, GL_GREEN, GL_ONE };
+        api.glTextureParameteriv(*handle, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    for (int level = 0; level < static_cast<int>(data.levels.size()); level++) {
+        // Compressed uploads only take the internal format
+        TextureRegion region;
+        region.handle = *handle;
+        region.level = level;
+        region.width = data.levels[level].width;
+        region.height = data.levels[level].height;
+        region.format = internalFormat;
+        uploader.upload(region, data.levels[level].data, data.getLevelByteSize(level));
+    }
 }
 
-static void loadTexture(std::string_view filePath, GLuint* handle)
+static void createDefaultTexture(TextureUploader& uploader, const uint8_t* texel, GLuint* handle)
 {
-    int width, height;
-    std::string filePathString(filePath);
-    const uint8_t* data = stbi_load(filePathString.c_str(), &width, &height, nullptr, STBI_rgb_alpha);
     api.glCreateTextures(GL_TEXTURE_2D, 1, handle);
-    api.glTextureParameteri(*handle, GL_TEXTURE_MAX_LEVEL, 0);
-    api.glTextureParameteri(*handle, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    api.glTextureParameteri(*handle, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    api.glTextureStorage2D(*handle, 1, GL_RGBA8, width, height);
-    api.glTextureSubImage2D(*handle, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    stbi_image_free((void*)data);
+    api.glTextureStorage2D(*handle, 1, GL_RGBA8, 1, 1);
+    TextureRegion region;
+    region.handle = *handle;
+    region.width = 1;
+    region.height = 1;
+    region.format = GL_RGBA;
+    region.type = GL_UNSIGNED_BYTE;
+    uploader.upload(region, texel, 4);
+}
+
+// assimp matrices are row-major
+static glm::mat4 toMat4(const aiMatrix4x4& matrix)
+{
+    return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
+static MeshData importMesh(std::string_view fileName)
+{
+    const std::string fileNameString(fileName);
+    MeshData data;
+    aiFileIO fileIO = { openImportFile, closeImportFile, reinterpret_cast<aiUserData>(&data.sourceFiles) };
+    const std::unique_ptr<const aiScene, decltype(&aiReleaseImport)> scene(aiImportFileEx(fileNameString.c_str(), importFlags, &fileIO), aiReleaseImport);
+    if (!scene || !scene->HasMeshes() || !scene->HasMaterials()) {
+        throw std::runtime_error("Unable to load mesh: " + fileNameString);
+    }
+
+    // Every mesh is packed once; the nodes referencing it only add draw commands
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<DrawElementsIndirectCommand> meshCommands;
+    std::vector<std::pair<glm::vec3, glm::vec3>> meshBounds;
+    for (unsigned int meshIndex = 0; meshIndex < scene->mNumMeshes; meshIndex++) {
+        const aiMesh* mesh = scene->mMeshes[meshIndex];
+        DrawElementsIndirectCommand command = { 0, 1, static_cast<uint32_t>(indices.size()), static_cast<int32_t>(vertices.size()), 0 };
+        // Point and line meshes are left empty
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+            const aiFace& face = mesh->mFaces[i];
+            if (face.mNumIndices == 3) {
+                indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+            }
+        }
+        command.count = static_cast<uint32_t>(indices.size()) - command.firstIndex;
+
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+            const aiVector3D pos = mesh->mVertices[i];
+            const aiVector3D normal = mesh->HasNormals() ? mesh->mNormals[i] : aiVector3D();
+            const aiVector3D uv = mesh->HasTextureCoords(0) ? mesh->mTextureCoords[0][i] : aiVector3D();
+            vertices.push_back({
+                .pos = glm::vec3(pos.x, pos.y, pos.z),
+                .normal = glm::vec3(normal.x, normal.y, normal.z),
+                .uv = glm::vec2(uv.x, -uv.y)
+            });
+            boundsMin = glm::min(boundsMin, vertices.back().pos);
+            boundsMax = glm::max(boundsMax, vertices.back().pos);
+        }
+        meshCommands.push_back(command);
+        meshBounds.push_back({ boundsMin, boundsMax });
+    }
+
+    // One draw per mesh reference in the node hierarchy, with the accumulated node transform
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<DrawData> draws;
+    glm::vec3 boundsMin(FLT_MAX);
+    glm::vec3 boundsMax(-FLT_MAX);
+    std::vector<std::pair<const aiNode*, glm::mat4>> nodes = { { scene->mRootNode, glm::mat4(1.0f) } };
+    while (!nodes.empty()) {
+        const auto [node, parentTransform] = nodes.back();
+        nodes.pop_back();
+        const glm::mat4 transform = parentTransform * toMat4(node->mTransformation);
+        for (unsigned int i = 0; i < node->mNumMeshes; i++) {
+            const unsigned int meshIndex = node->mMeshes[i];
+            if (meshCommands[meshIndex].count == 0) {
+                continue;
+            }
+            commands.push_back(meshCommands[meshIndex]);
+            draws.push_back({ transform, scene->mMeshes[meshIndex]->mMaterialIndex });
+            const auto [meshMin, meshMax] = meshBounds[meshIndex];
+            for (int corner = 0; corner < 8; corner++) {
+                const glm::vec3 pos(corner & 1 ? meshMax.x : meshMin.x, corner & 2 ? meshMax.y : meshMin.y, corner & 4 ? meshMax.z : meshMin.z);
+                const glm::vec3 transformedPos = glm::vec3(transform * glm::vec4(pos, 1.0f));
+                boundsMin = glm::min(boundsMin, transformedPos);
+                boundsMax = glm::max(boundsMax, transformedPos);
+            }
+        }
+        for (unsigned int i = 0; i < node->mNumChildren; i++) {
+            nodes.push_back({ node->mChildren[i], transform });
+        }
+    }
+    if (commands.empty()) {
+        throw std::runtime_error("No triangles in mesh: " + fileNameString);
+    }
+
+    // Factors as in glTF, and per slot the index of the texture file or -1 for the default texture.
+    // A file is loaded once per encoding it is used with.
+    const std::string dataPath = std::filesystem::path(fileName).parent_path().string() + "/";
+    std::vector<MaterialData> materials(scene->mNumMaterials);
+    std::vector<std::array<int32_t, materialTextureCount>> materialTextures(scene->mNumMaterials);
+    std::vector<std::pair<std::string, TextureEncoding>> textureFiles;
+    for (unsigned int materialIndex = 0; materialIndex < scene->mNumMaterials; materialIndex++) {
+        const aiMaterial* material = scene->mMaterials[materialIndex];
+        aiColor4D baseColor(1.0f, 1.0f, 1.0f, 1.0f);
+        if (material->Get(AI_MATKEY_BASE_COLOR, baseColor) != AI_SUCCESS) {
+            material->Get(AI_MATKEY_COLOR_DIFFUSE, baseColor);
+        }
+        aiColor4D emissive(0.0f, 0.0f, 0.0f, 1.0f);
+        material->Get(AI_MATKEY_COLOR_EMISSIVE, emissive);
+        float metallic = 0.0f;
+        material->Get(AI_MATKEY_METALLIC_FACTOR, metallic);
+        float roughness = 1.0f;
+        material->Get(AI_MATKEY_ROUGHNESS_FACTOR, roughness);
+        materials[materialIndex] = {
+            .baseColorFactor = glm::vec4(baseColor.r, baseColor.g, baseColor.b, baseColor.a),
+            .emissiveFactor = glm::vec4(emissive.r, emissive.g, emissive.b, 1.0f),
+            .metallicFactor = metallic,
+            .roughnessFactor = roughness
+        };
+
+        for (int slot = 0; slot < materialTextureCount; slot++) {
+            aiString textureFileName;
+            // Formats without PBR materials only have a diffuse texture
+            if (material->GetTexture(materialTextureTypes[slot], 0, &textureFileName) != AI_SUCCESS
+                && (slot != 0 || material->GetTexture(aiTextureType_DIFFUSE, 0, &textureFileName) != AI_SUCCESS)) {
+                materialTextures[materialIndex][slot] = -1;
+                continue;
+            }
+            const std::pair<std::string, TextureEncoding> textureFile = { dataPath + textureFileName.C_Str(), materialTextureEncodings[slot] };
+            const auto it = std::find(textureFiles.begin(), textureFiles.end(), textureFile);
+            materialTextures[materialIndex][slot] = static_cast<int>(it - textureFiles.begin());
+            if (it == textureFiles.end()) {
+                textureFiles.push_back(textureFile);
+            }
+        }
+    }
+
+    // The scene file itself is covered by the cache key
+    std::erase_if(data.sourceFiles, [&](const auto& sourceFile) { return sourceFile.first == fileNameString; });
+
+    // Center the scene at (0, 0, 0)
+    const glm::mat4 centering = glm::translate(glm::mat4(1.0f), -(boundsMin + boundsMax) / 2.0f);
+    for (DrawData& draw : draws) {
+        draw.transform = centering * draw.transform;
+    }
+
+    data.vertexStorage = std::move(vertices);
+    data.indexStorage = std::move(indices);
+    data.commandStorage = std::move(commands);
+    data.drawStorage = std::move(draws);
+    data.materialStorage = std::move(materials);
+    data.materialTextureStorage = std::move(materialTextures);
+    data.vertices = data.vertexStorage;
+    data.indices = data.indexStorage;
+    data.commands = data.commandStorage;
+    data.draws = data.drawStorage;
+    data.materials = data.materialStorage;
+    data.materialTextures = data.materialTextureStorage;
+    data.textureFiles = std::move(textureFiles);
+    return data;
+}
+
+// A file opened by an import, read from a mapping of the whole file
+struct ImportFile {
+    aiFile file;
+    MappedFile mappedFile;
+    size_t position = 0;
+};
+
+static ImportFile* getImportFile(aiFile* file)
+{
+    return reinterpret_cast<ImportFile*>(file->UserData);
+}
+
+static size_t readImportFile(aiFile* file, char* buffer, size_t size, size_t count)
+{
+    ImportFile* importFile = getImportFile(file);
+    if (size == 0) {
+        return 0;
+    }
+    count = std::min(count, (importFile->mappedFile.getSize() - importFile->position) / size);
+    std::memcpy(buffer, importFile->mappedFile.getData() + importFile->position, size * count);
+    importFile->position += size * count;
+    return count;
+}
+
+static size_t writeImportFile(aiFile*, const char*, size_t, size_t)
+{
+    return 0;
+}
+
+static size_t tellImportFile(aiFile* file)
+{
+    return getImportFile(file)->position;
+}
+
+static size_t getImportFileSize(aiFile* file)
+{
+    return getImportFile(file)->mappedFile.getSize();
+}
+
+static aiReturn seekImportFile(aiFile* file, size_t offset, aiOrigin origin)
+{
+    ImportFile* importFile = getImportFile(file);
+    const size_t base = origin == aiOrigin_SET ? 0 : origin == aiOrigin_CUR ? importFile->position : importFile->mappedFile.getSize();
+    if (base + offset > importFile->mappedFile.getSize()) {
+        return aiReturn_FAILURE;
+    }
+    importFile->position = base + offset;
+    return aiReturn_SUCCESS;
+}
+
+static void flushImportFile(aiFile*)
+{
+}
+
+// Files are only read, and every file that opens is recorded in the sourceFiles the user data points to
+static aiFile* openImportFile(aiFileIO* fileIO, const char* fileName, const char* mode)
+{
+    if (std::strchr(mode, 'w') || std::strchr(mode, 'a')) {
+        return nullptr;
+    }
+    ImportFile* importFile = new ImportFile{ { readImportFile, writeImportFile, tellImportFile, getImportFileSize, seekImportFile, flushImportFile, nullptr } };
+    importFile->file.UserData = reinterpret_cast<aiUserData>(importFile);
+    try {
+        importFile->mappedFile = MappedFile(fileName);
+    }
+    catch (const std::runtime_error&) {
+        delete importFile;
+        return nullptr;
+    }
+    auto& sourceFiles = *reinterpret_cast<std::vector<std::pair<std::string, uint64_t>>*>(fileIO->UserData);
+    if (std::none_of(sourceFiles.begin(), sourceFiles.end(), [&](const auto& sourceFile) { return sourceFile.first == fileName; })) {
+        sourceFiles.push_back({ fileName, hashBytes(importFile->mappedFile.getData(), importFile->mappedFile.getSize()) });
+    }
+    return &importFile->file;
+}
+
+static void closeImportFile(aiFileIO*, aiFile* file)
+{
+    delete getImportFile(file);
 }
@@ -1,6 +1,15 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "texture_cache.h"
+#include "texture_upload.h"
 
 struct VertexData {
 	glm::vec3 pos;
@@ -8,9 +17,77 @@ struct VertexData {
 	glm::vec2 uv;
 };
 
+// Layout of glMultiDrawElementsIndirect commands
+struct DrawElementsIndirectCommand {
+	uint32_t count;
+	uint32_t instanceCount;
+	uint32_t firstIndex;
+	int32_t baseVertex;
+	uint32_t baseInstance;
+};
+
+// Per-draw shader storage (std430), indexed by gl_DrawID
+struct DrawData {
+	glm::mat4 transform;
+	uint32_t material;
+	uint32_t padding[3];
+};
+
+constexpr int materialTextureCount = 5;
+
+// Per-material shader storage (std430). Textures are bindless handles in the order albedo, metallic roughness,
+// ambient occlusion, emissive and normals.
+struct MaterialData {
+	glm::vec4 baseColorFactor;
+	glm::vec4 emissiveFactor;
+	float metallicFactor;
+	float roughnessFactor;
+	GLuint64 textures[materialTextureCount];
+};
+
+// Everything a Mesh uploads, as imported with assimp or read from the mesh cache
+struct MeshData {
+	std::span<const VertexData> vertices;
+	std::span<const uint32_t> indices;
+	std::span<const DrawElementsIndirectCommand> commands;
+	// Transforms include the translation that centers the scene at (0, 0, 0)
+	std::span<const DrawData> draws;
+	// Texture handles are left 0
+	std::span<const MaterialData> materials;
+	// Per material and texture slot, the index into textureFiles or -1 for the default texture
+	std::span<const std::array<int32_t, materialTextureCount>> materialTextures;
+	std::vector<std::pair<std::string, TextureEncoding>> textureFiles;
+	// Files the import read, such as glTF buffers, with the hashes of their contents
+	std::vector<std::pair<std::string, uint64_t>> sourceFiles;
+	// Own what the spans point to: the vectors for imported data, the mapped file for cached data
+	std::vector<VertexData> vertexStorage;
+	std::vector<uint32_t> indexStorage;
+	std::vector<DrawElementsIndirectCommand> commandStorage;
+	std::vector<DrawData> drawStorage;
+	std::vector<MaterialData> materialStorage;
+	std::vector<std::array<int32_t, materialTextureCount>> materialTextureStorage;
+	MappedFile mappedFile;
+};
+
+// Sampling of the material textures
+enum class TextureFiltering {
+	// Level 0 only, as if the textures had no mips
+	Bilinear,
+	Trilinear,
+	// Trilinear with up to 16x anisotropy
+	Anisotropic
+};
+
+// All meshes of a scene, packed into one vertex and index buffer and drawn with a single multi-draw call.
+// Every mesh instance in the node hierarchy is one draw with its own transform and material.
 class Mesh {
 public:
-	explicit Mesh(std::string_view fileName);
+	// Textures are uploaded through uploader
+	explicit Mesh(std::string_view fileName, TextureUploader& uploader, TextureFiltering filtering = TextureFiltering::Anisotropic);
+	// Imports a scene file with assimp, unless <stem>-<path hash>.meshcache in the working directory was written for the
+	// same file contents, import flags and assimp version, and every other file the import read is unchanged.
+	// Imported scenes are added to the cache.
+	static MeshData loadData(std::string_view fileName);
 	~Mesh();
 
 	Mesh(const Mesh&) = delete;
@@ -19,17 +96,18 @@ public:
 	Mesh(Mesh&& other) noexcept;
 	Mesh& operator=(Mesh&& other) noexcept;
 
+	// Binds the vertex array, the draw commands and the draw and material storage buffers (bindings 2 and 3)
 	void bind() const;
 	void draw() const;
 private:
 	GLuint vao;
 	GLuint vertexData;
 	GLuint indexData;
-	GLuint textureAlbedo;
-	GLuint textureMetallicRougness;
-	GLuint textureAmbientOcclusion;
-	GLuint textureEmissive;
-	GLuint textureNormals;
-	std::vector<unsigned int> indices;
-	std::vector<VertexData> vertices;
+	GLuint commandData;
+	GLuint drawData;
+	GLuint materialData;
+	GLuint sampler;
+	GLsizei drawCount;
+	std::vector<GLuint> textures;
+	std::vector<GLuint64> textureHandles;
 };
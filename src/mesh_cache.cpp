@@ -0,0 +1,224 @@
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "cache_file.h"
+#include "mesh_cache.h"
+
+// Bump whenever the file layout changes
+static constexpr uint32_t cacheVersion = 1;
+static constexpr char cacheMagic[8] = { 'M', 'V', 'M', 'E', 'S', 'H', 'C', 'A' };
+// Arrays start at multiples of this, which satisfies the alignment of every element type
+static constexpr uint64_t cacheAlignment = 64;
+
+// Fixed-size file header. It is followed by the vertices, indices, commands, draws, materials and material
+// textures, each starting at the next multiple of cacheAlignment, and then by the texture files and source
+// files as length-prefixed strings.
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t padding;
+    uint64_t key;
+    uint64_t numVertices;
+    uint64_t numIndices;
+    uint64_t numCommands;
+    uint64_t numDraws;
+    uint64_t numMaterials;
+    uint64_t numTextureFiles;
+    uint64_t numSourceFiles;
+    uint64_t fileSize;
+};
+
+static uint64_t alignArray(uint64_t offset)
+{
+    return (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+}
+
+// Sequential reads from the mapped file that fail instead of reading past its end
+class CacheReader {
+public:
+    explicit CacheReader(const MappedFile& file) : file(file), offset(sizeof(MeshCacheHeader)) {}
+
+    template<typename T>
+    bool readArray(uint64_t count, std::span<const T>& array)
+    {
+        offset = alignArray(offset);
+        if (offset > file.getSize() || count > (file.getSize() - offset) / sizeof(T)) {
+            return false;
+        }
+        array = std::span<const T>(reinterpret_cast<const T*>(file.getData() + offset), count);
+        offset += count * sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool readValue(T& value)
+    {
+        if (offset > file.getSize() || sizeof(T) > file.getSize() - offset) {
+            return false;
+        }
+        std::memcpy(&value, file.getData() + offset, sizeof(T));
+        offset += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string& string)
+    {
+        uint32_t length;
+        if (!readValue(length) || length > file.getSize() - offset) {
+            return false;
+        }
+        string.assign(reinterpret_cast<const char*>(file.getData() + offset), length);
+        offset += length;
+        return true;
+    }
+
+    bool isAtEnd() const { return offset == file.getSize(); }
+private:
+    const MappedFile& file;
+    uint64_t offset;
+};
+
+// Sequential writes to the cache file stream, counting the bytes written
+class CacheWriter {
+public:
+    explicit CacheWriter(std::ofstream& file) : file(file), offset(0) {}
+
+    template<typename T>
+    void writeArray(std::span<const T> array)
+    {
+        const char padding[cacheAlignment] = {};
+        writeBytes(padding, alignArray(offset) - offset);
+        writeBytes(array.data(), array.size_bytes());
+    }
+
+    template<typename T>
+    void writeValue(const T& value)
+    {
+        writeBytes(&value, sizeof(T));
+    }
+
+    void writeString(const std::string& string)
+    {
+        writeValue(static_cast<uint32_t>(string.size()));
+        writeBytes(string.data(), string.size());
+    }
+
+    void writeBytes(const void* data, size_t size)
+    {
+        file.write(static_cast<const char*>(data), size);
+        offset += size;
+    }
+
+    uint64_t getOffset() const { return offset; }
+private:
+    std::ofstream& file;
+    uint64_t offset;
+};
+
+std::optional<MeshData> readMeshCache(std::string_view fileName, uint64_t key)
+{
+    MeshData data;
+    MeshCacheHeader header;
+    if (!openCacheFile(fileName, cacheMagic, cacheVersion, key, data.mappedFile, header)
+        || header.numCommands != header.numDraws) {
+        return std::nullopt;
+    }
+
+    // A file that does not end exactly after the last string was not written by writeMeshCache
+    CacheReader reader(data.mappedFile);
+    if (!reader.readArray(header.numVertices, data.vertices)
+        || !reader.readArray(header.numIndices, data.indices)
+        || !reader.readArray(header.numCommands, data.commands)
+        || !reader.readArray(header.numDraws, data.draws)
+        || !reader.readArray(header.numMaterials, data.materials)
+        || !reader.readArray(header.numMaterials, data.materialTextures)) {
+        return std::nullopt;
+    }
+    for (uint64_t i = 0; i < header.numTextureFiles; i++) {
+        uint32_t encoding;
+        std::string textureFileName;
+        if (!reader.readValue(encoding) || !reader.readString(textureFileName)
+            || encoding > static_cast<uint32_t>(TextureEncoding::Normals)) {
+            return std::nullopt;
+        }
+        data.textureFiles.push_back({ std::move(textureFileName), static_cast<TextureEncoding>(encoding) });
+    }
+    for (uint64_t i = 0; i < header.numSourceFiles; i++) {
+        uint64_t hash;
+        std::string sourceFileName;
+        if (!reader.readValue(hash) || !reader.readString(sourceFileName)) {
+            return std::nullopt;
+        }
+        data.sourceFiles.push_back({ std::move(sourceFileName), hash });
+    }
+    if (!reader.isAtEnd()) {
+        return std::nullopt;
+    }
+    // Indices into the other arrays are used as is
+    for (const DrawElementsIndirectCommand& command : data.commands) {
+        if (static_cast<uint64_t>(command.firstIndex) + command.count > header.numIndices
+            || command.baseVertex < 0 || static_cast<uint64_t>(command.baseVertex) >= header.numVertices) {
+            return std::nullopt;
+        }
+        // Indices are relative to the base vertex of their command
+        const uint64_t numCommandVertices = header.numVertices - command.baseVertex;
+        for (uint32_t index : data.indices.subspan(command.firstIndex, command.count)) {
+            if (index >= numCommandVertices) {
+                return std::nullopt;
+            }
+        }
+    }
+    for (const DrawData& draw : data.draws) {
+        if (draw.material >= header.numMaterials) {
+            return std::nullopt;
+        }
+    }
+    for (const std::array<int32_t, materialTextureCount>& textures : data.materialTextures) {
+        for (int32_t textureIndex : textures) {
+            if (textureIndex < -1 || textureIndex >= static_cast<int64_t>(header.numTextureFiles)) {
+                return std::nullopt;
+            }
+        }
+    }
+    return data;
+}
+
+bool writeMeshCache(std::string_view fileName, uint64_t key, const MeshData& data)
+{
+    MeshCacheHeader header = {};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.key = key;
+    header.numVertices = data.vertices.size();
+    header.numIndices = data.indices.size();
+    header.numCommands = data.commands.size();
+    header.numDraws = data.draws.size();
+    header.numMaterials = data.materials.size();
+    header.numTextureFiles = data.textureFiles.size();
+    header.numSourceFiles = data.sourceFiles.size();
+
+    return writeCacheFile(fileName, [&](std::ofstream& file) {
+        CacheWriter writer(file);
+        // The file size is only known at the end, so the header is written again once it is
+        writer.writeValue(header);
+        writer.writeArray(data.vertices);
+        writer.writeArray(data.indices);
+        writer.writeArray(data.commands);
+        writer.writeArray(data.draws);
+        writer.writeArray(data.materials);
+        writer.writeArray(data.materialTextures);
+        for (const auto& [textureFileName, encoding] : data.textureFiles) {
+            writer.writeValue(static_cast<uint32_t>(encoding));
+            writer.writeString(textureFileName);
+        }
+        for (const auto& [sourceFileName, hash] : data.sourceFiles) {
+            writer.writeValue(hash);
+            writer.writeString(sourceFileName);
+        }
+        header.fileSize = writer.getOffset();
+        file.seekp(0);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    });
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "mesh.h"
+
+// Returns the cached data if the file exists, is complete and was written for key. The arrays point into the
+// mapped file, so they are uploaded without a copy.
+std::optional<MeshData> readMeshCache(std::string_view fileName, uint64_t key);
+// Streams the file through writeCacheFile(). Returns false if the cache could not be written.
+bool writeMeshCache(std::string_view fileName, uint64_t key, const MeshData& data);
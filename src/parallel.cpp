@@ -0,0 +1,118 @@
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <utility>
+#include <filesystem>
+
+#include "parallel.h"
+
+static std::atomic<unsigned int> threadCount = 0;
+// Threads available to a parallelFor() called from within a worker of another one, 0 outside of workers
+static thread_local unsigned int nestedThreadCount = 0;
+// Threads beyond their callers' own that the outermost parallelFor() calls of all threads have reserved
+static std::atomic<unsigned int> reservedThreadCount = 0;
+
+// Reserves up to count threads of those the other outermost calls leave, returns how many it got
+static unsigned int reserveThreads(unsigned int count)
+{
+    const unsigned int limit = getThreadCount() - 1;
+    unsigned int reserved = reservedThreadCount;
+    unsigned int granted;
+    do {
+        granted = std::min(count, reserved < limit ? limit - reserved : 0u);
+    } while (!reservedThreadCount.compare_exchange_weak(reserved, reserved + granted));
+    return granted;
+}
+
+void setThreadCount(unsigned int count)
+{
+    threadCount = count;
+}
+
+unsigned int getThreadCount()
+{
+    const unsigned int count = threadCount;
+    if (count > 0) {
+        return count;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void parallelFor(int begin, int end, const std::function<void(int)>& body)
+{
+    if (begin >= end) {
+        return;
+    }
+    // An outermost call reserves the threads for itself and every call nested in it, so concurrent outermost calls
+    // together never run more than getThreadCount() threads besides their callers
+    struct Reservation {
+        unsigned int count = 0;
+        ~Reservation() { reservedThreadCount -= count; }
+    } reservation;
+    unsigned int availableThreads = nestedThreadCount;
+    if (availableThreads == 0) {
+        reservation.count = reserveThreads(getThreadCount() - 1);
+        availableThreads = reservation.count + 1;
+    }
+    const unsigned int numThreads = std::min(availableThreads, static_cast<unsigned int>(end - begin));
+    if (numThreads == 1) {
+        // Calls nested in a serial loop reserve threads of their own
+        reservedThreadCount -= std::exchange(reservation.count, 0);
+        for (int i = begin; i < end; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::atomic<int> next = begin;
+    std::exception_ptr exception;
+    std::mutex exceptionMutex;
+    const unsigned int workerThreadCount = std::max(availableThreads / numThreads, 1u);
+    auto worker = [&]() {
+        const unsigned int outerThreadCount = nestedThreadCount;
+        nestedThreadCount = workerThreadCount;
+        for (int i = next++; i < end; i = next++) {
+            try {
+                body(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(exceptionMutex);
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+                next = end;
+            }
+        }
+        nestedThreadCount = outerThreadCount;
+    };
+
+    {
+        std::vector<std::jthread> threads;
+        threads.reserve(numThreads - 1);
+        for (unsigned int i = 1; i < numThreads; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+    }
+
+    if (exception) {
+        std::rethrow_exception(exception);
+    }
+}
+
+void parallelForFiles(const std::vector<std::string_view>& fileNames, const std::function<void(int)>& body)
+{
+    std::vector<std::pair<uintmax_t, int>> order;
+    for (int i = 0; i < static_cast<int>(fileNames.size()); i++) {
+        std::error_code error;
+        const uintmax_t fileSize = std::filesystem::file_size(fileNames[i], error);
+        order.push_back({ error ? 0 : fileSize, i });
+    }
+    std::sort(order.begin(), order.end(), std::greater<>());
+    parallelFor(0, static_cast<int>(order.size()), [&](int i) {
+        body(order[i].second);
+    });
+}
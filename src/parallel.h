@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Number of threads used by parallelFor(); 0 (the default) uses all hardware threads.
+void setThreadCount(unsigned int count);
+unsigned int getThreadCount();
+
+// Calls body(i) for every i in [begin, end), distributing indices over the worker threads.
+// Indices are handed out dynamically, so results must not depend on which thread runs an index.
+// The first exception thrown by body is rethrown on the calling thread once all workers are done.
+// Calls from within body share the threads of the enclosing call, e.g. run serially if it uses all of them.
+// Concurrent calls from different threads share getThreadCount() the same way: each one only gets the threads
+// the others leave free, and runs serially on the calling thread if there are none.
+void parallelFor(int begin, int end, const std::function<void(int)>& body);
+// Calls body(i) for every index i of fileNames like parallelFor(), starting with the largest files so that a big one
+// does not start last and hold up the others. Files whose size cannot be read come last.
+void parallelForFiles(const std::vector<std::string_view>& fileNames, const std::function<void(int)>& body);
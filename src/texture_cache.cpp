@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "cache_file.h"
+#include "hash.h"
+#include "parallel.h"
+
+#include "texture_cache.h"
+
+// Bump whenever the file layout or the baking changes
+static constexpr uint32_t cacheVersion = 1;
+static constexpr char cacheMagic[8] = { 'M', 'V', 'T', 'E', 'X', 'C', 'A', 'C' };
+// Levels start at multiples of this
+static constexpr uint64_t cacheAlignment = 64;
+static constexpr ResampleFilter mipFilter = ResampleFilter::Kaiser;
+
+// Fixed-size file header, followed by the levels (largest first), each starting at the next multiple of cacheAlignment
+struct TextureCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t encoding;
+    uint64_t key;
+    uint32_t format;
+    int32_t numLevels;
+    int32_t width;
+    int32_t height;
+    uint64_t fileSize;
+};
+
+static uint64_t alignLevel(uint64_t offset)
+{
+    return (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+}
+
+static MipContent getMipContent(TextureEncoding encoding)
+{
+    switch (encoding) {
+    case TextureEncoding::ColorSRGB:
+        return MipContent::SRGB;
+    case TextureEncoding::Normals:
+        return MipContent::Normals;
+    default:
+        return MipContent::Linear;
+    }
+}
+
+// Moves roughness and metallic into the red and green channels that BC5 keeps
+static void moveMetallicRoughness(Bitmap& bitmap)
+{
+    for (int y = 0; y < bitmap.getHeight(); y++) {
+        const std::span<uint8_t> row = bitmap.getRow(y);
+        for (int x = 0; x < bitmap.getWidth(); x++) {
+            row[x * 4] = row[x * 4 + 1];
+            row[x * 4 + 1] = row[x * 4 + 2];
+        }
+    }
+}
+
+// Removes the entries of earlier contents of the same image file, which would otherwise stay in the cache forever
+static void removeStaleEntries(const std::string& prefix, const std::filesystem::path& current)
+{
+    std::error_code error;
+    for (std::filesystem::directory_iterator entry(current.parent_path(), error); !error && entry != std::filesystem::directory_iterator(); entry.increment(error)) {
+        const std::string name = entry->path().filename().string();
+        if (name.size() == prefix.size() + 16 + std::strlen(".texcache") && name.starts_with(prefix) && name.ends_with(".texcache")
+            && entry->path().filename() != current.filename()) {
+            std::error_code removeError;
+            std::filesystem::remove(entry->path(), removeError);
+        }
+    }
+}
+
+static TextureData bakeTexture(std::string_view fileName, TextureEncoding encoding)
+{
+    TextureData data;
+    data.encoding = encoding;
+    data.format = getTextureEncodingFormat(encoding);
+    for (Bitmap& level : Bitmap::generateMips(Bitmap(fileName, BitmapFormat::RGBA8), mipFilter, BitmapFormat::RGBA8, getMipContent(encoding))) {
+        if (encoding == TextureEncoding::MetallicRoughness) {
+            moveMetallicRoughness(level);
+        }
+        data.bitmaps.push_back(Bitmap::convertFormat(level, data.format));
+    }
+    for (const Bitmap& level : data.bitmaps) {
+        data.levels.push_back(TextureLevel{ level.getData(), level.getWidth(), level.getHeight() });
+    }
+    return data;
+}
+
+BitmapFormat getTextureEncodingFormat(TextureEncoding encoding)
+{
+    switch (encoding) {
+    case TextureEncoding::ColorSRGB:
+        return BitmapFormat::BC7;
+    case TextureEncoding::MetallicRoughness:
+    case TextureEncoding::Normals:
+        return BitmapFormat::BC5;
+    case TextureEncoding::Occlusion:
+        return BitmapFormat::BC4;
+    default:
+        throw std::invalid_argument("invalid texture encoding");
+    }
+}
+
+TextureData loadTextureData(std::string_view fileName, TextureEncoding encoding, std::string_view cacheDirectory)
+{
+    // Everything besides the file contents that affects the baked data
+    const int32_t parameters[] = {
+        static_cast<int32_t>(cacheVersion),
+        static_cast<int32_t>(encoding),
+        static_cast<int32_t>(mipFilter)
+    };
+    const uint64_t key = hashBytes(parameters, sizeof(parameters), hashFile(fileName));
+    // Entries of an image file in an encoding share a prefix: the file name and a hash of its path and the
+    // encoding, which tells apart images of the same name and the encodings of one image
+    const std::string path = std::filesystem::absolute(fileName).lexically_normal().string();
+    const uint64_t entryHash = hashBytes(path.data(), path.size(), hashBytes(&encoding, sizeof(encoding)));
+    char hashString[10];
+    std::snprintf(hashString, sizeof(hashString), "%08llx", static_cast<unsigned long long>(entryHash & 0xffffffffull));
+    char keyString[17];
+    std::snprintf(keyString, sizeof(keyString), "%016llx", static_cast<unsigned long long>(key));
+    const std::string prefix = std::filesystem::path(fileName).stem().string() + "-" + hashString + "-";
+    const std::filesystem::path cacheFileName = std::filesystem::path(cacheDirectory) / (prefix + keyString + ".texcache");
+    if (std::optional<TextureData> cached = readTextureCache(cacheFileName.string(), key)) {
+        return std::move(*cached);
+    }
+    TextureData data = bakeTexture(fileName, encoding);
+    // Without a cache the next start simply bakes the texture again
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (writeTextureCache(cacheFileName.string(), key, data)) {
+        removeStaleEntries(prefix, cacheFileName);
+    }
+    return data;
+}
+
+std::vector<TextureData> loadTextureData(const std::vector<std::pair<std::string, TextureEncoding>>& images, std::string_view cacheDirectory)
+{
+    std::vector<std::string_view> fileNames;
+    for (const auto& image : images) {
+        fileNames.push_back(image.first);
+    }
+    std::vector<TextureData> textures(images.size());
+    parallelForFiles(fileNames, [&](int i) {
+        const auto& [fileName, encoding] = images[i];
+        textures[i] = loadTextureData(fileName, encoding, cacheDirectory);
+    });
+    return textures;
+}
+
+std::optional<TextureData> readTextureCache(std::string_view fileName, uint64_t key)
+{
+    TextureData data;
+    TextureCacheHeader header;
+    if (!openCacheFile(fileName, cacheMagic, cacheVersion, key, data.mappedFile, header)) {
+        return std::nullopt;
+    }
+    const uint8_t* fileData = data.mappedFile.getData();
+    const uint64_t fileSize = data.mappedFile.getSize();
+    if (header.width < 1 || header.height < 1 || header.encoding > static_cast<uint32_t>(TextureEncoding::Normals)) {
+        return std::nullopt;
+    }
+    // At most the full chain down to 1x1 that Bitmap::generateMips() builds
+    const int maxLevels = std::bit_width(static_cast<uint32_t>(std::max(header.width, header.height)));
+    if (header.numLevels < 1 || header.numLevels > maxLevels) {
+        return std::nullopt;
+    }
+    data.encoding = static_cast<TextureEncoding>(header.encoding);
+    data.format = getTextureEncodingFormat(data.encoding);
+    if (header.format != static_cast<uint32_t>(data.format)) {
+        return std::nullopt;
+    }
+
+    // Point the levels into the mapping; a file that does not end exactly after the last level was not written by writeTextureCache
+    uint64_t offset = sizeof(header);
+    for (int level = 0; level < header.numLevels; level++) {
+        data.levels.push_back(TextureLevel{ nullptr, std::max(header.width >> level, 1), std::max(header.height >> level, 1) });
+        offset = alignLevel(offset);
+        if (offset + data.getLevelByteSize(level) > fileSize) {
+            return std::nullopt;
+        }
+        data.levels.back().data = fileData + offset;
+        offset += data.getLevelByteSize(level);
+    }
+    if (offset != fileSize) {
+        return std::nullopt;
+    }
+    return data;
+}
+
+bool writeTextureCache(std::string_view fileName, uint64_t key, const TextureData& data)
+{
+    TextureCacheHeader header = {};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = cacheVersion;
+    header.encoding = static_cast<uint32_t>(data.encoding);
+    header.key = key;
+    header.format = static_cast<uint32_t>(data.format);
+    header.numLevels = static_cast<int32_t>(data.levels.size());
+    header.width = data.levels[0].width;
+    header.height = data.levels[0].height;
+    header.fileSize = sizeof(header);
+    for (int level = 0; level < header.numLevels; level++) {
+        header.fileSize = alignLevel(header.fileSize) + data.getLevelByteSize(level);
+    }
+
+    return writeCacheFile(fileName, [&](std::ofstream& file) {
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        const char padding[cacheAlignment] = {};
+        uint64_t offset = sizeof(header);
+        for (int level = 0; level < header.numLevels; level++) {
+            file.write(padding, alignLevel(offset) - offset);
+            file.write(reinterpret_cast<const char*>(data.levels[level].data), data.getLevelByteSize(level));
+            offset = alignLevel(offset) + data.getLevelByteSize(level);
+        }
+    });
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bitmap.h"
+#include "mapped_file.h"
+
+// Block-compressed encodings of material textures
+enum class TextureEncoding {
+    // BC7 of sRGB colors with alpha: albedo and emissive
+    ColorSRGB,
+    // BC5 of roughness (green) and metallic (blue) moved to red and green; the texture swizzles them back
+    MetallicRoughness,
+    // BC4 of the red channel: ambient occlusion
+    Occlusion,
+    // BC5 of the tangent-space x and y; z is reconstructed in the shader
+    Normals
+};
+
+// One mip level of a material texture
+struct TextureLevel {
+    const uint8_t* data = nullptr;
+    int width = 0;
+    int height = 0;
+};
+
+// Everything Mesh uploads for a material texture, as baked from an image file or read from the texture cache
+struct TextureData {
+    TextureEncoding encoding = TextureEncoding::ColorSRGB;
+    BitmapFormat format = BitmapFormat::BC7;
+    // Full mip chain, largest level first
+    std::vector<TextureLevel> levels;
+    // Own the texels the levels point to: bitmaps for baked data, the mapped file for cached data
+    std::vector<Bitmap> bitmaps;
+    MappedFile mappedFile;
+
+    size_t getLevelByteSize(int level) const { return Bitmap::getLayerByteSize(format, levels[level].width, levels[level].height); }
+};
+
+BitmapFormat getTextureEncodingFormat(TextureEncoding encoding);
+
+// Bakes an image file into encoding: a Kaiser-filtered mip chain (see Bitmap::generateMips()) whose levels are
+// block-compressed in parallel. Skipped if <cacheDirectory>/<stem>-<path hash>-<key>.texcache was written for the
+// same file contents and encoding; otherwise the baked texture is added to the cache, replacing the entries of
+// earlier contents of the file.
+TextureData loadTextureData(std::string_view fileName, TextureEncoding encoding, std::string_view cacheDirectory = "texturecache");
+// Same for several images, concurrently and largest files first through parallelForFiles()
+std::vector<TextureData> loadTextureData(const std::vector<std::pair<std::string, TextureEncoding>>& images, std::string_view cacheDirectory = "texturecache");
+
+// Returns the cached data if the file exists, is complete and was written for key
+std::optional<TextureData> readTextureCache(std::string_view fileName, uint64_t key);
+// Writes through writeCacheFile(). Returns false if the cache could not be written.
+bool writeTextureCache(std::string_view fileName, uint64_t key, const TextureData& data);
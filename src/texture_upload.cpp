@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "texture_upload.h"
+
+// Allocations start at multiples of this, which satisfies the alignment of every pixel type
+static constexpr size_t uploadAlignment = 64;
+// Persistent and coherent, so pixels written before copy() reach the GPU without flushing or remapping
+static constexpr GLbitfield uploadMapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+// Nanoseconds upload() waits for a fence before it checks the result and waits again
+static constexpr GLuint64 fenceWaitTimeout = 100000000;
+
+static void uploadRegion(const TextureRegion& region, const void* pixels, size_t bytes);
+
+TextureUploader::TextureUploader(size_t size) : size(size)
+{
+    api.glCreateBuffers(1, &buffer);
+    api.glNamedBufferStorage(buffer, size, nullptr, uploadMapFlags);
+    mapping = static_cast<uint8_t*>(api.glMapNamedBufferRange(buffer, 0, size, uploadMapFlags));
+    if (!mapping) {
+        api.glDeleteBuffers(1, &buffer);
+        throw std::runtime_error("Could not map the texture upload buffer");
+    }
+    // Staged rows are tightly packed
+    api.glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+}
+
+TextureUploader::~TextureUploader()
+{
+    for (const Fence& fence : fences) {
+        api.glDeleteSync(fence.sync);
+    }
+    api.glUnmapNamedBuffer(buffer);
+    api.glDeleteBuffers(1, &buffer);
+}
+
+std::optional<UploadAllocation> TextureUploader::allocate(size_t bytes, std::stop_token stopToken)
+{
+    if (bytes > size) {
+        throw std::length_error("Upload exceeds the texture upload ring");
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    std::optional<UploadAllocation> allocation;
+    released.wait(lock, stopToken, [&]() {
+        allocation = tryAllocate(bytes);
+        return allocation.has_value();
+    });
+    return allocation;
+}
+
+void TextureUploader::copy(const UploadAllocation& allocation, const TextureRegion& region)
+{
+    // With an unpack buffer bound, the pixel pointer is an offset into the buffer
+    api.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    uploadRegion(region, reinterpret_cast<const void*>(allocation.offset), allocation.size);
+    api.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    batchHasCopies = true;
+    std::lock_guard<std::mutex> lock(mutex);
+    Record& record = getRecord(allocation);
+    record.state = RecordState::Copied;
+    record.batch = batch;
+}
+
+void TextureUploader::discard(const UploadAllocation& allocation)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    getRecord(allocation).state = RecordState::Discarded;
+}
+
+void TextureUploader::upload(const TextureRegion& region, const void* data, size_t bytes)
+{
+    std::optional<UploadAllocation> allocation;
+    if (bytes <= size) {
+        do {
+            std::lock_guard<std::mutex> lock(mutex);
+            allocation = tryAllocate(bytes);
+        } while (!allocation && waitForRelease());
+    }
+    if (!allocation) {
+        uploadRegion(region, data, bytes);
+        return;
+    }
+    std::memcpy(allocation->data, data, bytes);
+    copy(*allocation, region);
+}
+
+void TextureUploader::update()
+{
+    fenceBatch();
+    while (!fences.empty()) {
+        const GLenum result = api.glClientWaitSync(fences.front().sync, 0, 0);
+        if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        completedBatch = fences.front().batch;
+        api.glDeleteSync(fences.front().sync);
+        fences.pop_front();
+    }
+    release();
+}
+
+// Expects the mutex to be locked
+std::optional<UploadAllocation> TextureUploader::tryAllocate(size_t bytes)
+{
+    // The free memory runs from head to the oldest record, wrapping around at the end of the ring
+    const size_t alignedHead = std::min((head + uploadAlignment - 1) / uploadAlignment * uploadAlignment, size);
+    size_t begin;
+    if (records.empty()) {
+        begin = 0;
+    }
+    else if (head > records.front().begin) {
+        if (alignedHead + bytes <= size) {
+            begin = alignedHead;
+        }
+        else if (bytes <= records.front().begin) {
+            begin = 0;
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+    else if (alignedHead + bytes <= records.front().begin) {
+        begin = alignedHead;
+    }
+    else {
+        return std::nullopt;
+    }
+    records.push_back({ begin, begin + bytes, RecordState::Staged, 0 });
+    head = begin + bytes;
+    return UploadAllocation{ mapping + begin, bytes, begin, firstRecordId + records.size() - 1 };
+}
+
+// Expects the mutex to be locked
+TextureUploader::Record& TextureUploader::getRecord(const UploadAllocation& allocation)
+{
+    return records[allocation.id - firstRecordId];
+}
+
+void TextureUploader::fenceBatch()
+{
+    if (batchHasCopies) {
+        fences.push_back({ api.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), batch });
+        batch++;
+        batchHasCopies = false;
+    }
+}
+
+// Waits for the oldest fence and releases the memory behind it. Returns false if there is nothing to wait for,
+// i.e. all memory in use belongs to allocations that are still being written.
+bool TextureUploader::waitForRelease()
+{
+    fenceBatch();
+    if (fences.empty()) {
+        return false;
+    }
+    GLenum result;
+    do {
+        result = api.glClientWaitSync(fences.front().sync, GL_SYNC_FLUSH_COMMANDS_BIT, fenceWaitTimeout);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    if (result == GL_WAIT_FAILED) {
+        throw std::runtime_error("Waiting for texture uploads failed");
+    }
+    completedBatch = fences.front().batch;
+    api.glDeleteSync(fences.front().sync);
+    fences.pop_front();
+    release();
+    return true;
+}
+
+// Pops the records the GPU is done with, in ring order
+void TextureUploader::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!records.empty()) {
+            const Record& record = records.front();
+            if (record.state == RecordState::Staged || (record.state == RecordState::Copied && record.batch > completedBatch)) {
+                break;
+            }
+            records.pop_front();
+            firstRecordId++;
+        }
+        if (records.empty()) {
+            head = 0;
+        }
+    }
+    released.notify_all();
+}
+
+static void uploadRegion(const TextureRegion& region, const void* pixels, size_t bytes)
+{
+    const bool isCompressed = region.type == 0;
+    if (region.target == GL_TEXTURE_2D) {
+        if (isCompressed) {
+            api.glCompressedTextureSubImage2D(region.handle, region.level, region.x, region.y, region.width, region.height,
+                region.format, static_cast<GLsizei>(bytes), pixels);
+        }
+        else {
+            api.glTextureSubImage2D(region.handle, region.level, region.x, region.y, region.width, region.height,
+                region.format, region.type, pixels);
+        }
+        return;
+    }
+    if (isCompressed) {
+        api.glCompressedTextureSubImage3D(region.handle, region.level, region.x, region.y, region.z, region.width, region.height,
+            region.depth, region.format, static_cast<GLsizei>(bytes), pixels);
+    }
+    else {
+        api.glTextureSubImage3D(region.handle, region.level, region.x, region.y, region.z, region.width, region.height,
+            region.depth, region.format, region.type, pixels);
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+
+#include "gl/gl.h"
+
+// Part of a texture level that TextureUploader fills from staging memory
+struct TextureRegion {
+    GLuint handle = 0;
+    // GL_TEXTURE_2D, or GL_TEXTURE_CUBE_MAP with z and depth selecting a range of faces
+    GLenum target = GL_TEXTURE_2D;
+    int level = 0;
+    int x = 0;
+    int y = 0;
+    int z = 0;
+    int width = 0;
+    int height = 0;
+    int depth = 1;
+    // Pixel format and type of tightly packed rows, or the internal format and type 0 for compressed data
+    GLenum format = 0;
+    GLenum type = 0;
+};
+
+// Staging memory handed out by TextureUploader::allocate()
+struct UploadAllocation {
+    uint8_t* data = nullptr;
+    size_t size = 0;
+    size_t offset = 0;
+    uint64_t id = 0;
+};
+
+// Streams texture data through a ring of pixel unpack buffer memory that stays mapped for the lifetime of the uploader.
+// Worker threads allocate staging memory and write pixels into it; the GL thread then only issues the copies into the
+// textures, which the GPU carries out asynchronously. Copies are fenced once per update(), and their memory is
+// reused once the GPU has passed the fence.
+class TextureUploader {
+public:
+    explicit TextureUploader(size_t size);
+    ~TextureUploader();
+
+    TextureUploader(const TextureUploader&) = delete;
+    TextureUploader& operator=(const TextureUploader&) = delete;
+
+    size_t getSize() const { return size; }
+
+    // Any thread except the GL thread. Waits until update() has released enough memory, or returns nothing once
+    // stopToken is triggered. Allocations must be passed to copy() or discard() eventually, since the ring is reused
+    // in allocation order. Throws std::length_error if bytes exceeds the ring.
+    std::optional<UploadAllocation> allocate(size_t bytes, std::stop_token stopToken);
+    // GL thread. Copies a completely written allocation into region.
+    void copy(const UploadAllocation& allocation, const TextureRegion& region);
+    // Any thread. Returns an allocation that will not be copied.
+    void discard(const UploadAllocation& allocation);
+
+    // GL thread. Stages bytes of data and copies them into region, waiting for the GPU if the ring is full.
+    // Falls back to an upload from client memory if data does not fit the ring, or the ring is held by allocations
+    // that are still being written.
+    void upload(const TextureRegion& region, const void* data, size_t bytes);
+
+    // GL thread, once per frame. Fences the copies issued since the last call and releases the memory of all
+    // copies the GPU has finished.
+    void update();
+private:
+    enum class RecordState {
+        Staged,
+        Copied,
+        Discarded
+    };
+
+    struct Record {
+        size_t begin;
+        size_t end;
+        RecordState state;
+        // update() call whose fence follows the copy
+        uint64_t batch;
+    };
+
+    struct Fence {
+        GLsync sync;
+        uint64_t batch;
+    };
+
+    std::optional<UploadAllocation> tryAllocate(size_t bytes);
+    Record& getRecord(const UploadAllocation& allocation);
+    void fenceBatch();
+    bool waitForRelease();
+    void release();
+
+    GLuint buffer;
+    uint8_t* mapping;
+    size_t size;
+
+    // Guards the allocation records, which are ordered by offset in the ring starting at the oldest one
+    std::mutex mutex;
+    std::condition_variable_any released;
+    std::deque<Record> records;
+    uint64_t firstRecordId = 0;
+    size_t head = 0;
+
+    // Only used on the GL thread
+    std::deque<Fence> fences;
+    uint64_t batch = 1;
+    uint64_t completedBatch = 0;
+    bool batchHasCopies = false;
+};